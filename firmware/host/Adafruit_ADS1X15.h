@@ -0,0 +1,14 @@
+#ifndef HOST_ADAFRUIT_ADS1X15_H
+#define HOST_ADAFRUIT_ADS1X15_H
+
+#include "Arduino.h"
+
+// Analog inputs are stubbed out in SensorManager; report 0 V
+class Adafruit_ADS1115 {
+public:
+  bool begin(uint8_t addr) { return (void)addr, true; }
+  int16_t readADC_SingleEnded(uint8_t ch) { return (void)ch, 0; }
+  float computeVolts(int16_t counts) { return counts * 0.000125f; }
+};
+
+#endif
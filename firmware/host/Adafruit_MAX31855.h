@@ -0,0 +1,25 @@
+#ifndef HOST_ADAFRUIT_MAX31855_H
+#define HOST_ADAFRUIT_MAX31855_H
+
+#include "Arduino.h"
+
+#define MAX31855_FAULT_OPEN (0x01)
+#define MAX31855_FAULT_SHORT_GND (0x02)
+#define MAX31855_FAULT_SHORT_VCC (0x04)
+
+// Reads the simulated temperature of whichever TcChannel owns the CS pin,
+// with the faults HostPlant injects
+class Adafruit_MAX31855 {
+public:
+  explicit Adafruit_MAX31855(int8_t cs) : _cs(cs), _err(0) {}
+  bool begin() { return true; }
+  double readCelsius();
+  double readInternal() { return 25.0; }
+  uint8_t readError() { return _err; }
+
+private:
+  int8_t _cs;
+  uint8_t _err; // Fault flags of the last readCelsius()
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_ADAFRUIT_MCP4725_H
+#define HOST_ADAFRUIT_MCP4725_H
+
+#include "Arduino.h"
+
+// Last value written to the (only) DAC, the MFC command HostPlant reads
+inline uint16_t &hostDacCounts() {
+  static uint16_t counts = 0;
+  return counts;
+}
+
+class Adafruit_MCP4725 {
+public:
+  bool begin(uint8_t addr) { return (void)addr, true; }
+  bool setVoltage(uint16_t counts, bool writeEEPROM) {
+    (void)writeEEPROM;
+    hostDacCounts() = counts;
+    return true;
+  }
+};
+
+#endif
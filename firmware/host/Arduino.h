@@ -0,0 +1,116 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal Arduino core for the native (host) build. Only what the firmware
+// uses is provided: time, GPIO, Print and a Serial backed by a pty or TCP
+// socket (see HostSerial.cpp). Pin writes are recorded so HostPlant can
+// turn SSR duty into heat.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef std::string String;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define HEX 16
+#define DEC 10
+
+// Flash strings: PROGMEM is ordinary memory on the host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define strcmp_P strcmp
+#define snprintf_P snprintf
+
+#define constrain(amt, low, high)                                              \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Host only: run on simulated time (replay). millis()/micros() then follow
+// hostClockAdvance(), and delay() moves the clock instead of sleeping.
+void hostClockSimulate();
+void hostClockAdvance(unsigned long us);
+
+#define HOST_NUM_PINS 70 // Mega 2560
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) {
+    size_t written = 0;
+    while (n--)
+      written += write(*buf++);
+    return written;
+  }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(const __FlashStringHelper *s) {
+    return write(reinterpret_cast<const char *>(s));
+  }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) {
+    return print((unsigned long)n, base);
+  }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) {
+    return print((unsigned long)n, base);
+  }
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(const T &v) {
+    size_t n = print(v);
+    return n + println();
+  }
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud);
+  void end();
+  int available();
+  int read();
+  void flush();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  operator bool() { return true; }
+
+  unsigned long baud() const { return _baud; }
+
+private:
+  unsigned long _baud = 0;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,81 @@
+#include "Arduino.h"
+#include <chrono>
+#include <thread>
+
+// --- Time ---
+// Function-local so it is set on first use: global constructors in the
+// firmware (HeaterBank) call millis() before this file's statics would be.
+static std::chrono::steady_clock::time_point bootTime() {
+  static const std::chrono::steady_clock::time_point t =
+      std::chrono::steady_clock::now();
+  return t;
+}
+
+static bool simClock = false;
+static uint64_t simUs = 0;
+
+void hostClockSimulate() { simClock = true; }
+
+void hostClockAdvance(unsigned long us) { simUs += us; }
+
+static uint64_t elapsedUs() {
+  if (simClock)
+    return simUs;
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - bootTime())
+      .count();
+}
+
+// Truncated to 32 bits like the AVR core so wrap handling is exercised
+unsigned long micros() { return (uint32_t)elapsedUs(); }
+
+unsigned long millis() { return (uint32_t)(elapsedUs() / 1000); }
+
+void delay(unsigned long ms) {
+  if (simClock)
+    simUs += (uint64_t)ms * 1000;
+  else
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (simClock)
+    simUs += us;
+  else
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// --- GPIO ---
+static uint8_t pinLevel[HOST_NUM_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin, (void)mode; }
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < HOST_NUM_PINS)
+    pinLevel[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < HOST_NUM_PINS ? pinLevel[pin] : LOW;
+}
+
+// --- Print ---
+size_t Print::print(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == HEX)
+    return print((unsigned long)n, base);
+  char buf[8 * sizeof(long) + 2];
+  snprintf(buf, sizeof(buf), "%ld", n);
+  return write(buf);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
@@ -0,0 +1,146 @@
+#include "HostPlant.h"
+#include "Adafruit_MAX31855.h"
+#include "Adafruit_MCP4725.h"
+
+// Flow load, degrees C per second: FLOW_LOAD_PER_K per sccm per degree above
+// the inlet, FLOW_LOAD_VAPORIZE per sccm in the vaporizer
+#define FLOW_LOAD_PER_K 4e-5
+#define FLOW_LOAD_VAPORIZE 5e-3
+#define MFC_TAU_S 0.3
+
+// Conduction between the heater nodes of coupled zones (ZoneDef::coupledZone),
+// per second per degree of difference
+#define ZONE_COUPLING 0.015
+
+HostPlant::HostPlant()
+    : ambientC(25.0), flowSccm(0), coupling(ZONE_COUPLING),
+      flowLoadPerK(FLOW_LOAD_PER_K), flowLoadVaporize(FLOW_LOAD_VAPORIZE),
+      tcGlitchRate(0), tcGlitchBurst(1), _rng(1) {
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++) {
+    tcFault[ch] = 0;
+    _glitchLeft[ch] = 0;
+  }
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    // Reactor: internal heats fast, external lags
+    if (ZONES[z].pvSecondary != TC_NONE)
+      zones[z] = {30.0, 0.02, 0.1, 0.01};
+    else
+      zones[z] = {40.0, 0.05, 0, 0};
+    _int[z] = ambientC;
+    _ext[z] = ambientC;
+  }
+}
+
+void HostPlant::setTemps(uint8_t zone, double heaterC, double wallC) {
+  _int[zone] = heaterC;
+  _ext[zone] = ZONES[zone].pvSecondary != TC_NONE ? wallC : heaterC;
+}
+
+HostPlant &HostPlant::instance() {
+  static HostPlant plant;
+  return plant;
+}
+
+void HostPlant::step(double dt) {
+  // Invert FlowController's DAC scaling; below MFC_VOLTAGE_MIN is closed
+  double volts = hostDacCounts() * 5.0 / 4095.0;
+  double target = volts <= MFC_VOLTAGE_MIN
+                      ? 0
+                      : (volts - MFC_VOLTAGE_MIN) /
+                            (MFC_VOLTAGE_MAX - MFC_VOLTAGE_MIN) *
+                            MFC_FLOW_MAX_SCCM;
+  flowSccm += (target - flowSccm) * (dt / (MFC_TAU_S + dt));
+
+  double prevInt[ZONE_COUNT];
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    prevInt[z] = _int[z];
+
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    double duty = digitalRead(ZONES[z].heaterPin) == HIGH ? 1.0 : 0.0;
+
+    // Gas passes through preheat and vaporizer, both fed at ambient
+    uint8_t pin = ZONES[z].heaterPin;
+    double flowLoad = 0;
+    if (pin == PIN_HEATER_GAS || pin == PIN_HEATER_VAPORIZER)
+      flowLoad = flowSccm * flowLoadPerK * (_int[z] - ambientC);
+    if (pin == PIN_HEATER_VAPORIZER)
+      flowLoad += flowSccm * flowLoadVaporize;
+
+    double conducted = 0;
+    if (ZONES[z].coupledZone != ZONE_NONE)
+      conducted = (prevInt[ZONES[z].coupledZone] - prevInt[z]) * coupling;
+
+    const ZonePlant &p = zones[z];
+    _int[z] += (duty * p.heat - (_int[z] - ambientC) * p.loss + conducted -
+                flowLoad) *
+               dt;
+    if (ZONES[z].pvSecondary != TC_NONE)
+      _ext[z] += ((_int[z] - _ext[z]) * p.wallRate -
+                  (_ext[z] - ambientC) * p.wallLoss) *
+                 dt;
+    else
+      _ext[z] = _int[z];
+  }
+}
+
+double HostPlant::tcTemp(int8_t csPin) const {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (TC_CHANNELS[ZONES[z].pvPrimary].csPin == csPin)
+      return _int[z];
+    if (ZONES[z].pvSecondary != TC_NONE &&
+        TC_CHANNELS[ZONES[z].pvSecondary].csPin == csPin)
+      return _ext[z];
+  }
+  return ambientC; // Not part of a zone (feedstock)
+}
+
+// xorshift32, so a seeded run injects the same faults on every platform
+double HostPlant::random01() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng / 4294967296.0;
+}
+
+enum GlitchKind { GLITCH_CHIP_FAULT, GLITCH_SPI_NAN, GLITCH_SPI_VALUE };
+
+double HostPlant::readTc(int8_t csPin, uint8_t &err) {
+  err = 0;
+  double t = tcTemp(csPin);
+  uint8_t ch = 0;
+  while (ch < TC_COUNT && TC_CHANNELS[ch].csPin != csPin)
+    ch++;
+  if (ch == TC_COUNT)
+    return t;
+
+  if (tcFault[ch] != 0) {
+    err = tcFault[ch];
+    return NAN;
+  }
+
+  if (_glitchLeft[ch] == 0 && tcGlitchRate > 0 &&
+      random01() < tcGlitchRate) {
+    _glitchLeft[ch] = 1 + (uint8_t)(random01() * tcGlitchBurst);
+    _glitchKind[ch] = (uint8_t)(random01() * 3);
+    _glitchCode[ch] = 1 << (uint8_t)(random01() * 3);
+  }
+  if (_glitchLeft[ch] == 0)
+    return t;
+
+  _glitchLeft[ch]--;
+  switch (_glitchKind[ch]) {
+  case GLITCH_CHIP_FAULT:
+    err = _glitchCode[ch];
+    return NAN;
+  case GLITCH_SPI_NAN:
+    return NAN;
+  default:
+    // A flipped bit in the 14-bit temperature field: 64 to 1024 degrees off
+    return t + (random01() < 0.5 ? -1 : 1) *
+                   (double)(64 << (uint8_t)(random01() * 5));
+  }
+}
+
+double Adafruit_MAX31855::readCelsius() {
+  return HostPlant::instance().readTc(_cs, _err);
+}
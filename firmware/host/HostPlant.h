@@ -0,0 +1,77 @@
+#ifndef HOST_PLANT_H
+#define HOST_PLANT_H
+
+#include "ZoneConfig.h"
+
+// Lumped thermal model standing in for the rig on the host build. Each zone
+// is a heater-side node (the internal TC) and a lagging wall node (the
+// external TC, if the zone has one), heated in proportion to the SSR pin
+// level and losing heat to ambient. Coefficients match mock_arduino.py.
+//
+// Gas flow (from the MFC DAC, with a first-order lag) carries heat out of the
+// gas preheat and vaporizer zones: sensible heat from the inlet temperature
+// up to the zone temperature, plus vaporization in the vaporizer. This is the
+// disturbance flow feedforward compensates.
+//
+// Coupled zones (the two reactor zones on one tube) conduct heat between
+// their heater nodes, which is what reactor decoupling compensates.
+//
+// The coefficients are public so the replay build can load ones fitted to a
+// recorded run; the defaults match mock_arduino.py.
+//
+// Thermocouple faults can be injected per TcChannel: a MAX31855 fault held
+// until cleared (a broken or shorted TC), and random glitch bursts of one of
+// three kinds: the chip flagging a fault from noise on the TC leads, an SPI
+// read that returns NaN with clean fault flags, and one that returns a wrong
+// value.
+
+// Per zone, degrees C per second
+struct ZonePlant {
+  double heat;     // Heater node rise at full SSR duty
+  double loss;     // Heater node loss per degree above ambient
+  double wallRate; // Wall node approach to the heater node, per degree
+  double wallLoss; // Wall node loss per degree above ambient
+};
+
+class HostPlant {
+public:
+  HostPlant();
+  static HostPlant &instance();
+
+  void step(double dtSeconds); // Integrate using current heater pin levels
+  double tcTemp(int8_t csPin) const;
+
+  // A read of the TC on csPin with injected faults; err gets the MAX31855
+  // fault flags a readError() right after it would see
+  double readTc(int8_t csPin, uint8_t &err);
+  void seed(uint32_t seed) { _rng = seed ? seed : 1; }
+
+  void setTemps(uint8_t zone, double heaterC, double wallC);
+  double heaterTemp(uint8_t zone) const { return _int[zone]; }
+  double wallTemp(uint8_t zone) const { return _ext[zone]; }
+
+  double ambientC;
+  double flowSccm; // Actual MFC flow
+
+  ZonePlant zones[ZONE_COUNT];
+  double coupling;         // Between coupled heater nodes, per degree
+  double flowLoadPerK;     // Per sccm per degree above the inlet
+  double flowLoadVaporize; // Per sccm, vaporizer only
+
+  uint8_t tcFault[TC_COUNT]; // MAX31855_FAULT_* bits held, 0 = none
+  double tcGlitchRate;       // Chance per read of a glitch burst starting
+  uint8_t tcGlitchBurst;     // Longest burst, in reads
+
+private:
+  double _int[ZONE_COUNT];
+  double _ext[ZONE_COUNT];
+
+  uint32_t _rng;
+  uint8_t _glitchLeft[TC_COUNT];
+  uint8_t _glitchKind[TC_COUNT];
+  uint8_t _glitchCode[TC_COUNT];
+
+  double random01();
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "HostSerial.h"
+#include "Arduino.h"
+#include <arpa/inet.h>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+
+// Same RX/TX buffer sizes as the AVR core. Bytes reach the RX ring at the
+// UART rate set by Serial.begin() and are lost while it is full, which is
+// what happens on the Mega when loop() stalls. Writes beyond the TX buffer
+// block for their time on the wire.
+#define HOST_RX_BUFFER_SIZE 64
+#define HOST_TX_BUFFER_SIZE 64
+
+static int dataFd = -1;   // pty master or connected TCP client
+static int listenFd = -1; // TCP mode only
+static int ptySlaveFd = -1;
+static bool isSocket = false;
+
+static uint8_t rxBuf[HOST_RX_BUFFER_SIZE];
+static uint8_t rxHead = 0, rxTail = 0;
+static unsigned long rxOverflows = 0;
+
+// micros() wraps at 32 bits, so these are compared as int32_t differences
+static std::deque<uint8_t> rxWire; // Sent by the host, not yet through the UART
+static double rxCredit = 0;        // Byte-times elapsed since last delivery
+static uint32_t rxLastUs = 0;
+static uint32_t txFreeAtUs = 0; // When the TX buffer will have drained
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+const char *hostSerialOpenPty() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    return nullptr;
+
+  const char *path = ptsname(master);
+  if (path == nullptr)
+    return nullptr;
+
+  // Hold the slave open so the master doesn't see EIO between clients, and
+  // make it raw so nothing we send is echoed back to us.
+  ptySlaveFd = open(path, O_RDWR | O_NOCTTY);
+  if (ptySlaveFd >= 0) {
+    struct termios tio;
+    tcgetattr(ptySlaveFd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(ptySlaveFd, TCSANOW, &tio);
+  }
+
+  setNonBlocking(master);
+  dataFd = master;
+  isSocket = false;
+  return path;
+}
+
+bool hostSerialListenTcp(int port) {
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    return false;
+
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listenFd, 1) != 0)
+    return false;
+
+  setNonBlocking(listenFd);
+  isSocket = true;
+  return true;
+}
+
+unsigned long hostSerialRxOverflows() { return rxOverflows; }
+
+static void dropClient() {
+  if (isSocket && dataFd >= 0) {
+    close(dataFd);
+    dataFd = -1;
+  }
+}
+
+// Accept a pending client and move whatever the fd has into the RX ring
+static void pollTransport() {
+  if (isSocket && dataFd < 0) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+      return;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setNonBlocking(fd);
+    dataFd = fd;
+    rxHead = rxTail = 0;
+    rxWire.clear();
+  }
+  if (dataFd < 0)
+    return;
+
+  // Bytes that were idle in the fd start on the wire now, not at the last
+  // poll, or a long loop iteration would deliver a whole frame at once
+  bool wasIdle = rxWire.empty();
+  uint8_t chunk[256];
+  ssize_t n;
+  while ((n = ::read(dataFd, chunk, sizeof(chunk))) > 0)
+    rxWire.insert(rxWire.end(), chunk, chunk + n);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                 errno != EIO)) {
+    dropClient();
+    return;
+  }
+
+  // Release bytes at 10 bits per byte
+  uint32_t now = micros();
+  if (rxWire.empty() || wasIdle) {
+    rxCredit = 0;
+  } else {
+    rxCredit += (now - rxLastUs) * (Serial.baud() / 10.0) / 1e6;
+  }
+  rxLastUs = now;
+
+  while (rxCredit >= 1.0 && !rxWire.empty()) {
+    rxCredit -= 1.0;
+    uint8_t c = rxWire.front();
+    rxWire.pop_front();
+
+    uint8_t next = (rxHead + 1) % HOST_RX_BUFFER_SIZE;
+    if (next == rxTail) {
+      rxOverflows++;
+      continue;
+    }
+    rxBuf[rxHead] = c;
+    rxHead = next;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud) { _baud = baud; }
+
+void HardwareSerial::end() {}
+
+int HardwareSerial::available() {
+  pollTransport();
+  return (HOST_RX_BUFFER_SIZE + rxHead - rxTail) % HOST_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::read() {
+  if (rxHead == rxTail)
+    return -1;
+  uint8_t c = rxBuf[rxTail];
+  rxTail = (rxTail + 1) % HOST_RX_BUFFER_SIZE;
+  return c;
+}
+
+void HardwareSerial::flush() {
+  // Wait for the TX buffer to drain
+  int32_t remainingUs = (int32_t)(txFreeAtUs - (uint32_t)micros());
+  if (remainingUs > 0)
+    delayMicroseconds(remainingUs);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+// Blocks for as long as the AVR would spend waiting on a full TX buffer
+static void paceTx(size_t n, unsigned long baud) {
+  if (baud == 0)
+    return;
+  double byteUs = 10e6 / baud;
+  uint32_t now = micros();
+  if ((int32_t)(txFreeAtUs - now) < 0)
+    txFreeAtUs = now;
+  txFreeAtUs += (uint32_t)(n * byteUs);
+
+  int32_t excessUs =
+      (int32_t)(txFreeAtUs - now) - (int32_t)(HOST_TX_BUFFER_SIZE * byteUs);
+  if (excessUs > 0)
+    delayMicroseconds(excessUs);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t n) {
+  paceTx(n, _baud);
+
+  size_t done = 0;
+  while (dataFd >= 0 && done < n) {
+    ssize_t w = isSocket ? send(dataFd, buf + done, n - done, MSG_NOSIGNAL)
+                         : ::write(dataFd, buf + done, n - done);
+    if (w > 0) {
+      done += w;
+    } else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {dataFd, POLLOUT, 0};
+      if (poll(&pfd, 1, 100) <= 0 && !isSocket)
+        break; // Nobody is reading the pty, drop rather than hang
+    } else {
+      dropClient();
+      break;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,15 @@
+#ifndef HOST_SERIAL_H
+#define HOST_SERIAL_H
+
+// Transport behind the host Serial object. The supervisor connects either to
+// the printed pty path (SERIAL_PORT=/dev/pts/N, exercising pyserial) or to
+// SERIAL_PORT=socket://127.0.0.1:<port>.
+
+// Returns the slave path, or nullptr on failure
+const char *hostSerialOpenPty();
+bool hostSerialListenTcp(int port);
+
+// Bytes dropped because the 64-byte RX ring (as on the Mega) was full
+unsigned long hostSerialRxOverflows();
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+// Thermocouples are simulated by HostPlant, nothing to drive
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_WPROGRAM_H
+#define HOST_WPROGRAM_H
+// br3ttb/PID picks this pre-1.0 core header when ARDUINO is undefined, as it
+// is on the host (defining it would switch ArduinoJson to Arduino types)
+#include "Arduino.h"
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+// I2C devices are simulated, nothing to drive
+#endif
@@ -0,0 +1,62 @@
+// Entry point for the native build: runs the unmodified firmware setup() and
+// loop() against HostPlant, with Serial on a pty or TCP socket.
+//
+//   .pio/build/native/program            -> prints "HOST_PTY /dev/pts/N"
+//   .pio/build/native/program --tcp 9999 -> socket://127.0.0.1:9999
+//   --node N answers to node N instead of NODE_ID
+
+#include "Arduino.h"
+#include "HostPlant.h"
+#include "HostSerial.h"
+#include "SerialComms.h"
+#include <unistd.h>
+
+void setup();
+void loop();
+
+extern SerialComms comms;
+
+int main(int argc, char **argv) {
+  int tcpPort = 0;
+  int node = NODE_ID;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc)
+      tcpPort = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--node") == 0 && i + 1 < argc)
+      node = atoi(argv[++i]);
+  }
+  if (node < 1 || node > 254) {
+    fprintf(stderr, "HOST_ERROR node must be 1-254\n");
+    return 1;
+  }
+
+  if (tcpPort) {
+    if (!hostSerialListenTcp(tcpPort)) {
+      fprintf(stderr, "HOST_ERROR cannot listen on %d\n", tcpPort);
+      return 1;
+    }
+    fprintf(stderr, "HOST_TCP socket://127.0.0.1:%d\n", tcpPort);
+  } else {
+    const char *path = hostSerialOpenPty();
+    if (path == nullptr) {
+      fprintf(stderr, "HOST_ERROR cannot open pty\n");
+      return 1;
+    }
+    fprintf(stderr, "HOST_PTY %s\n", path);
+  }
+
+  setup();
+  comms.setNode(node);
+
+  HostPlant &plant = HostPlant::instance();
+  unsigned long last = micros();
+  for (;;) {
+    loop();
+
+    unsigned long now = micros();
+    plant.step((uint32_t)(now - last) / 1e6);
+    last = now;
+
+    usleep(100); // Don't spin a core; still far faster than the AVR loop
+  }
+}
@@ -0,0 +1,401 @@
+// Entry point for the replay build: runs the unmodified firmware setup() and
+// loop() in simulated time against HostPlant, driven by a recorded run.
+//
+//   .pio/build/replay/program case.txt --trace trace.csv [--step-us 1000]
+//                             [--rearm]
+//
+// case.txt is written by supervisory/tests/bench_control_replay.py from a
+// recorded run. One directive per line, events in time order:
+//   ambient <C>
+//   plant <zone> <heat> <loss> <wallRate> <wallLoss>   (see ZonePlant)
+//   coupling <per K>
+//   flowload <per sccm per K> <per sccm>
+//   init <zone> <heater node C> <wall node C>
+//   baud <rate>                      (the rate the supervisor negotiated)
+//   seed <n>                         (for injected TC faults)
+//   tcglitch <chance per read> <longest burst in reads>
+//   <t s> state <ControlState>       (as SET_STATE)
+//   <t s> sp <zone> <C>              (as SET_TEMP)
+//   <t s> flow <sccm>                (as SET_FLOW)
+//   <t s> pid <zone> <kp> <ki> <kd>  (as SET_PID)
+//   <t s> tcfault <TcChannel> <MAX31855_FAULT_* bits, 0 clears>
+//   end <t s>
+//
+// The supervisor's heartbeat is simulated, so the watchdog never trips.
+// With --rearm the last commanded state is restored right after each trip to
+// STATE_FAULT, as an operator would, so a long run can count nuisance trips.
+// Each pass of loop() is followed by --step-us of simulated time, which is
+// the SSR duty resolution, plus whatever loop() spent in delay() or blocked
+// on Serial at the configured baud.
+//
+// The trace has a row per control tick: simulated time, state, and per zone
+// setpoint, process temperature (plant nodes averaged as the zone's PV is),
+// heater output, cumulative SSR switch count, and the plant's heater and wall
+// node temperatures. The summary on stdout is JSON with the host CPU time of
+// loop() passes that ran a control tick, per zone the time of its share of
+// HeaterBank::update() in those ticks (ZONE_PROFILE hooks, less their own
+// overhead; TSC cycles on x86, else ns), the trips to STATE_FAULT, and per TC
+// the control ticks it spent faulted.
+
+#include "Arduino.h"
+#include "FlowController.h"
+#include "HeaterController.h"
+#include "HostPlant.h"
+#include "SerialComms.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLES 0
+static inline uint64_t cycles() { return 0; }
+#endif
+
+#ifndef ZONE_PROFILE
+#error "the replay build needs -DZONE_PROFILE for the per-zone cost"
+#endif
+
+// Per zone, the time its ZONE_PROFILE_BEGIN/END sections took in the
+// current control tick and how many there were. A section's timing overhead
+// (zoneOverhead, measured at start) is taken off: it is most of a zone's cost.
+static uint64_t zoneStart[ZONE_COUNT], zoneTick[ZONE_COUNT];
+static unsigned zoneSections[ZONE_COUNT];
+static uint64_t zoneOverhead;
+
+static inline uint64_t zoneStamp() {
+  if (HAVE_CYCLES)
+    return cycles();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void zoneProfileBegin(uint8_t zone) { zoneStart[zone] = zoneStamp(); }
+void zoneProfileEnd(uint8_t zone) {
+  zoneTick[zone] += zoneStamp() - zoneStart[zone];
+  zoneSections[zone]++;
+}
+
+static void calibrateZoneProfile() {
+  std::vector<uint64_t> empty;
+  for (int i = 0; i < 10000; i++) {
+    zoneTick[0] = 0;
+    zoneProfileBegin(0);
+    zoneProfileEnd(0);
+    empty.push_back(zoneTick[0]);
+  }
+  std::nth_element(empty.begin(), empty.begin() + empty.size() / 2,
+                   empty.end());
+  zoneOverhead = empty[empty.size() / 2];
+  zoneTick[0] = 0;
+  zoneSections[0] = 0;
+}
+
+void setup();
+void loop();
+
+// Firmware globals (main.cpp) that the supervisor's commands act on
+extern HeaterController heaters;
+extern FlowController flow;
+extern ControlState currentState;
+extern unsigned long lastHeartbeatTime;
+extern unsigned long lastLoopTime;
+extern SensorManager sensors;
+
+enum EventType { EV_STATE, EV_SP, EV_FLOW, EV_TC_FAULT, EV_PID };
+
+struct Event {
+  double t;
+  EventType type;
+  int zone; // TcChannel for EV_TC_FAULT
+  double value;
+  double ki, kd; // EV_PID, value is kp
+};
+
+struct Case {
+  std::vector<Event> events;
+  double endS = 0;
+  unsigned long baud = SERIAL_BAUD;
+  bool init[ZONE_COUNT] = {};
+  double initC[ZONE_COUNT][2];
+};
+
+static bool loadCase(const char *path, Case &c) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr)
+    return false;
+
+  HostPlant &plant = HostPlant::instance();
+  char line[256];
+  int lineNo = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    lineNo++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    int z;
+    double a, b, d, e;
+    char kind[16];
+    if (sscanf(line, "ambient %lf", &a) == 1) {
+      plant.ambientC = a;
+    } else if (sscanf(line, "plant %d %lf %lf %lf %lf", &z, &a, &b, &d, &e) ==
+               5) {
+      ok = z >= 0 && z < ZONE_COUNT;
+      if (ok)
+        plant.zones[z] = {a, b, d, e};
+    } else if (sscanf(line, "coupling %lf", &a) == 1) {
+      plant.coupling = a;
+    } else if (sscanf(line, "flowload %lf %lf", &a, &b) == 2) {
+      plant.flowLoadPerK = a;
+      plant.flowLoadVaporize = b;
+    } else if (sscanf(line, "init %d %lf %lf", &z, &a, &b) == 3) {
+      ok = z >= 0 && z < ZONE_COUNT;
+      if (ok) {
+        c.init[z] = true;
+        c.initC[z][0] = a;
+        c.initC[z][1] = b;
+      }
+    } else if (sscanf(line, "baud %lf", &a) == 1) {
+      c.baud = (unsigned long)a;
+    } else if (sscanf(line, "seed %lf", &a) == 1) {
+      plant.seed((uint32_t)a);
+    } else if (sscanf(line, "tcglitch %lf %lf", &a, &b) == 2) {
+      ok = a >= 0 && b >= 1 && b <= 255;
+      plant.tcGlitchRate = a;
+      plant.tcGlitchBurst = (uint8_t)b;
+    } else if (sscanf(line, "end %lf", &a) == 1) {
+      c.endS = a;
+    } else if (sscanf(line, "%lf %15s", &a, kind) == 2) {
+      Event ev = {a, EV_STATE, -1, 0, 0, 0};
+      if (strcmp(kind, "state") == 0) {
+        ok = sscanf(line, "%*f %*s %lf", &ev.value) == 1;
+      } else if (strcmp(kind, "sp") == 0) {
+        ev.type = EV_SP;
+        ok = sscanf(line, "%*f %*s %d %lf", &ev.zone, &ev.value) == 2 &&
+             ev.zone >= 0 && ev.zone < ZONE_COUNT;
+      } else if (strcmp(kind, "flow") == 0) {
+        ev.type = EV_FLOW;
+        ok = sscanf(line, "%*f %*s %lf", &ev.value) == 1;
+      } else if (strcmp(kind, "pid") == 0) {
+        ev.type = EV_PID;
+        ok = sscanf(line, "%*f %*s %d %lf %lf %lf", &ev.zone, &ev.value, &ev.ki,
+                    &ev.kd) == 4 &&
+             ev.zone >= 0 && ev.zone < ZONE_COUNT;
+      } else if (strcmp(kind, "tcfault") == 0) {
+        ev.type = EV_TC_FAULT;
+        ok = sscanf(line, "%*f %*s %d %lf", &ev.zone, &ev.value) == 2 &&
+             ev.zone >= 0 && ev.zone < TC_COUNT;
+      } else {
+        ok = false;
+      }
+      if (ok)
+        c.events.push_back(ev);
+    } else {
+      ok = false;
+    }
+  }
+  fclose(f);
+  if (!ok)
+    fprintf(stderr, "REPLAY_ERROR %s:%d: %s", path, lineNo, line);
+  return ok;
+}
+
+static void apply(const Event &ev) {
+  switch (ev.type) {
+  case EV_STATE:
+    currentState = (ControlState)(int)ev.value;
+    break;
+  case EV_SP:
+    heaters.setSetpoint(ev.zone, ev.value);
+    break;
+  case EV_FLOW:
+    flow.setFlow(ev.value);
+    break;
+  case EV_TC_FAULT:
+    HostPlant::instance().tcFault[ev.zone] = (uint8_t)ev.value;
+    break;
+  case EV_PID:
+    heaters.setTunings(ev.zone, ev.value, ev.ki, ev.kd);
+    break;
+  }
+}
+
+// The temperature the zone's PV measures, without sensor effects
+static double processTemp(uint8_t z) {
+  const HostPlant &plant = HostPlant::instance();
+  if (ZONES[z].pvSecondary != TC_NONE)
+    return (plant.heaterTemp(z) + plant.wallTemp(z)) / 2.0;
+  return plant.heaterTemp(z);
+}
+
+template <typename T> static T percentile(std::vector<T> &v, double p) {
+  if (v.empty())
+    return 0;
+  size_t k = (size_t)(p / 100.0 * (v.size() - 1) + 0.5);
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+int main(int argc, char **argv) {
+  const char *casePath = nullptr;
+  const char *tracePath = nullptr;
+  unsigned long stepUs = 1000;
+  bool rearm = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--rearm") == 0)
+      rearm = true;
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+      tracePath = argv[++i];
+    else if (strcmp(argv[i], "--step-us") == 0 && i + 1 < argc)
+      stepUs = strtoul(argv[++i], nullptr, 10);
+    else
+      casePath = argv[i];
+  }
+  if (casePath == nullptr || stepUs == 0) {
+    fprintf(stderr,
+            "usage: %s case.txt [--trace out.csv] [--step-us N] [--rearm]\n",
+            argv[0]);
+    return 2;
+  }
+
+  hostClockSimulate();
+  Case c;
+  if (!loadCase(casePath, c))
+    return 1;
+
+  FILE *trace = nullptr;
+  if (tracePath != nullptr) {
+    trace = fopen(tracePath, "w");
+    if (trace == nullptr) {
+      fprintf(stderr, "REPLAY_ERROR cannot write %s\n", tracePath);
+      return 1;
+    }
+    fprintf(trace, "t_s,state");
+    for (uint8_t z = 0; z < ZONE_COUNT; z++)
+      fprintf(trace, ",sp_%s,pv_%s,out_%s,ssr_%s,heater_%s,wall_%s",
+              ZONES[z].key, ZONES[z].key, ZONES[z].key, ZONES[z].key,
+              ZONES[z].key, ZONES[z].key);
+    fprintf(trace, "\n");
+  }
+
+  HostPlant &plant = HostPlant::instance();
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    if (c.init[z])
+      plant.setTemps(z, c.initC[z][0], c.initC[z][1]);
+  }
+
+  calibrateZoneProfile();
+  setup();
+  Serial.begin(c.baud);
+
+  std::vector<uint32_t> tickNs, tickCycles;
+  std::vector<uint32_t> zoneCost[ZONE_COUNT]; // Ticks the heaters ran
+  ControlState commanded = currentState;
+  unsigned trips = 0;
+  unsigned long tcFaultedTicks[TC_COUNT] = {};
+  unsigned long switches[ZONE_COUNT] = {};
+  int lastPin[ZONE_COUNT];
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    lastPin[z] = digitalRead(ZONES[z].heaterPin);
+
+  auto wall0 = std::chrono::steady_clock::now();
+  size_t next = 0;
+  uint32_t lastUs = micros();
+  uint64_t endUs = (uint64_t)(c.endS * 1e6);
+  uint64_t simUs = 0;
+  while (simUs < endUs) {
+    while (next < c.events.size() && c.events[next].t * 1e6 <= simUs) {
+      apply(c.events[next]);
+      if (c.events[next++].type == EV_STATE)
+        commanded = currentState;
+    }
+    lastHeartbeatTime = millis();
+
+    ControlState stateBefore = currentState;
+    unsigned long tickBefore = lastLoopTime;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles();
+    loop();
+    uint64_t c1 = cycles();
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (currentState == STATE_FAULT && stateBefore != STATE_FAULT) {
+      trips++;
+      if (rearm)
+        currentState = commanded;
+    }
+
+    if (lastLoopTime != tickBefore) {
+      uint32_t status = sensors.getLastReadings().sensorStatus;
+      for (uint8_t ch = 0; ch < TC_COUNT; ch++)
+        tcFaultedTicks[ch] += (status & ERR_TC(ch)) != 0;
+      tickCycles.push_back((uint32_t)(c1 - c0));
+      for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+        if (zoneSections[z] != 0) {
+          uint64_t overhead = zoneSections[z] * zoneOverhead;
+          zoneCost[z].push_back(
+              (uint32_t)(zoneTick[z] > overhead ? zoneTick[z] - overhead : 0));
+        }
+        zoneTick[z] = 0;
+        zoneSections[z] = 0;
+      }
+      tickNs.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0)
+              .count());
+      if (trace != nullptr) {
+        fprintf(trace, "%.3f,%d", millis() / 1000.0, (int)currentState);
+        for (uint8_t z = 0; z < ZONE_COUNT; z++)
+          fprintf(trace, ",%.2f,%.3f,%.1f,%lu,%.3f,%.3f",
+                  heaters.getSetpoint(z), processTemp(z), heaters.getOutput(z),
+                  switches[z], HostPlant::instance().heaterTemp(z),
+                  HostPlant::instance().wallTemp(z));
+        fprintf(trace, "\n");
+      }
+    }
+
+    for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+      int pin = digitalRead(ZONES[z].heaterPin);
+      if (pin != lastPin[z])
+        switches[z]++;
+      lastPin[z] = pin;
+    }
+
+    hostClockAdvance(stepUs);
+    uint32_t now = micros();
+    plant.step((uint32_t)(now - lastUs) / 1e6);
+    lastUs = now;
+    simUs += (uint32_t)(now - (uint32_t)simUs);
+  }
+  double wallS = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - wall0)
+                     .count();
+  if (trace != nullptr)
+    fclose(trace);
+
+  printf("{\"sim_s\": %.3f, \"wall_s\": %.3f, \"ticks\": %u, "
+         "\"tick_ns_p50\": %u, \"tick_ns_p99\": %u",
+         simUs / 1e6, wallS, (unsigned)tickNs.size(), percentile(tickNs, 50),
+         percentile(tickNs, 99));
+  if (HAVE_CYCLES)
+    printf(", \"tick_cycles_p50\": %u, \"tick_cycles_p99\": %u",
+           percentile(tickCycles, 50), percentile(tickCycles, 99));
+  printf(", \"zone_update_%s\": {", HAVE_CYCLES ? "cycles" : "ns");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    printf("%s\"%s\": [%u, %u]", z ? ", " : "", ZONES[z].key,
+           percentile(zoneCost[z], 50), percentile(zoneCost[z], 99));
+  printf("}");
+  printf(", \"ssr_switches\": {");
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    printf("%s\"%s\": %lu", z ? ", " : "", ZONES[z].key, switches[z]);
+  printf("}, \"trips\": %u, \"tc_faulted_ticks\": {", trips);
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++)
+    printf("%s\"%s\": %lu", ch ? ", " : "", TC_CHANNELS[ch].key,
+           tcFaultedTicks[ch]);
+  printf("}}\n");
+  return 0;
+}
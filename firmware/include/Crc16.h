@@ -0,0 +1,33 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <Arduino.h>
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF). Matches Python's
+// binascii.crc_hqx(data, 0xFFFF) on the supervisor side.
+#define CRC16_INIT 0xFFFF
+
+inline uint16_t crc16Update(uint16_t crc, uint8_t b) {
+  crc ^= (uint16_t)b << 8;
+  for (uint8_t i = 0; i < 8; i++)
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  return crc;
+}
+
+// Print adapter that checksums everything written through it
+class CrcPrint : public Print {
+public:
+  explicit CrcPrint(Print &out) : crc(CRC16_INIT), _out(out) {}
+
+  // Out of line: inlined, GCC speculatively devirtualizes _out.write() to
+  // this very function and warns about the result (-Warray-bounds)
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  uint16_t crc;
+
+private:
+  Print &_out;
+};
+
+#endif
@@ -12,6 +12,7 @@ public:
   void setFlow(float sccm);
   void setEnabled(bool enabled);
   float getSetpoint();
+  float getCommandedFlow(); // What the MFC is driven to, 0 while disabled
 
 private:
   Adafruit_MCP4725 dac;
@@ -1,56 +1,112 @@
 #ifndef HEATER_CONTROLLER_H
 #define HEATER_CONTROLLER_H
 
+#include "ZoneConfig.h"
 #include "config.h"
 #include <Arduino.h>
 #include <PID_v1.h>
 
-
 // Time Proportional Window Size (ms)
 #define WINDOW_SIZE 1000
 
-class HeaterController {
+// Hooks around each zone's share of update(), defined by the replay build
+// (host/replay, -DZONE_PROFILE) to report its cost per zone. Empty otherwise.
+#ifdef ZONE_PROFILE
+void zoneProfileBegin(uint8_t zone);
+void zoneProfileEnd(uint8_t zone);
+#define ZONE_PROFILE_BEGIN(zone) zoneProfileBegin(zone)
+#define ZONE_PROFILE_END(zone) zoneProfileEnd(zone)
+#else
+#define ZONE_PROFILE_BEGIN(zone)
+#define ZONE_PROFILE_END(zone)
+#endif
+
+// One PID + time-proportional SSR output per zone. Templated on the zone
+// count so every per-tick loop has a compile-time trip count; the firmware
+// uses the HeaterController alias sized from ZONES[].
+//
+// Zones with feedforward coefficients get heater output proportional to the
+// flow setpoint added on top of the PID, so a flow step is compensated before
+// the temperature sags. The PID's limits are shifted by the feedforward so it
+// can still trim below it.
+//
+// Coupled zones (ZoneDef::coupledZone) can have their outputs decoupled: each
+// gets a gain times the other's PID output added, optionally through a
+// first-order lag, so a PID no longer fights its neighbour's heat. The PIDs
+// then each see roughly their own zone. Changing the gains while running is
+// bumpless. Per coupled zone and tick that is 2 float multiplies, 3
+// adds and a compare: about 650 cycles of AVR soft-float, so ~80 us of the
+// 100 ms tick for the reactor pair (0.08%).
+//
+// A derated zone (controlled on a backup TC) has its output capped at
+// TC_FAILOVER_DUTY_RATIO times its mean duty from before, tracked over
+// TC_FAILOVER_DUTY_AVG_S while it isn't derated, until the caller clears it.
+template <uint8_t N> class HeaterBank {
 public:
-  HeaterController();
+  explicit HeaterBank(const ZoneDef *zones);
   void begin();
-  void update(float tempGas, float tempVaporizer, float tempReactor);
-  void setSetpoints(float spGas, float spVaporizer, float spReactor1,
-                    float spReactor2);
-  void update(float tempGas, float tempVaporizer, float tempReactor1,
-              float tempReactor2);
+  bool setSetpoint(uint8_t zone, float sp);
+  bool setFeedforward(uint8_t zone, float base, float perK);
+  bool setDecoupling(uint8_t zone, float k, float lagS);
+  bool setTunings(uint8_t zone, float kp, float ki, float kd);
+  void setDerated(uint8_t zone, bool derated);
+  bool isDerated(uint8_t zone) const { return _derated[zone]; }
+
+  // pv: N process values, indexed by zone. tc: TC_COUNT temperatures for
+  // feedforward inlets. flowSccm: commanded flow.
+  void update(const float *pv, const float *tc, float flowSccm);
+
+  // Switches the SSRs for the current duty. Call on every loop() pass; the
+  // duty resolution is the time between calls.
+  void service();
+
   void setEnabled(bool enabled);
 
   // Telemetry getters
-  float getOutputGas() { return _outGas; }
-  float getOutputVaporizer() { return _outVaporizer; }
-  float getOutputReactor1() { return _outReactor1; }
-  float getOutputReactor2() { return _outReactor2; }
+  float getOutput(uint8_t zone) const { return _duty[zone]; }
+  float getSetpoint(uint8_t zone) const { return _sp[zone]; }
 
-  float getSetpointGas() { return _spGas; }
-  float getSetpointVaporizer() { return _spVaporizer; }
-  float getSetpointReactor1() { return _spReactor1; }
-  float getSetpointReactor2() { return _spReactor2; }
+  static constexpr uint8_t zoneCount() { return N; }
 
 private:
+  const ZoneDef *_zones; // In flash, read with pgm_read_*()
   bool _enabled;
   unsigned long _windowStartTime;
 
   // PID Variables (Double required by Library)
-  double _spGas, _inGas, _outGas;
-  double _spVaporizer, _inVaporizer, _outVaporizer;
-  double _spReactor1, _inReactor1, _outReactor1;
-  double _spReactor2, _inReactor2, _outReactor2;
+  double _sp[N], _in[N], _out[N];
+
+  // Feedforward coefficients and the current term
+  float _ffBase[N], _ffPerK[N], _ff[N];
+
+  // Decoupling gain, lag filter coefficient and the lagged cross term
+  float _dcK[N], _dcAlpha[N], _dcX[N];
+
+  // Output applied to the SSR, ms of WINDOW_SIZE
+  float _duty[N];
+
+  // Mean duty while not derated, the reference for the failover cap
+  float _dutyAvg[N];
+  bool _derated[N];
 
   // PID Objects
-  PID *_pidGas;
-  PID *_pidVaporizer;
-  PID *_pidReactor1;
-  PID *_pidReactor2;
+  PID *_pid[N];
 
-  // Tuning Parameters (Initial Conservative Guesses)
+  // Tuning Parameters (Initial Conservative Guesses, SET_PID per zone)
   double _kp = 2.0, _ki = 0.5, _kd = 1.0;
 
-  void applyTimeProportional(int pin, double output);
+  float feedforward(uint8_t zone, const float *tc, float flowSccm) const;
+  float decoupling(uint8_t zone);
+  float maxOutput(uint8_t zone) const {
+    return _derated[zone] ? constrain(TC_FAILOVER_DUTY_RATIO * _dutyAvg[zone],
+                                      0, WINDOW_SIZE)
+                          : WINDOW_SIZE;
+  }
+  void rebaseCoupled(uint8_t zone);
+  void allOff();
+  void applyTimeProportional(uint8_t pin, double output);
 };
 
+typedef HeaterBank<ZONE_COUNT> HeaterController;
+
 #endif
@@ -0,0 +1,79 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+
+// Writes a JSON object straight to a Print, for outgoing frames. Keys come
+// from flash (F() or the PROGMEM keys in ZoneConfig.h), so nothing needs a
+// JsonDocument on the stack or key strings in SRAM. NaN and infinity are
+// written as null, as ArduinoJson does.
+class JsonStream {
+public:
+  explicit JsonStream(Print &out) : _out(out), _first(true) { _out.print('{'); }
+
+  template <typename T> void add(const __FlashStringHelper *k, T v) {
+    key(k);
+    _out.print(v);
+  }
+
+  void add(const __FlashStringHelper *k, float v) {
+    key(k);
+    if (isnan(v) || isinf(v))
+      _out.print(F("null"));
+    else
+      _out.print(v, 2);
+  }
+
+  void add(const __FlashStringHelper *k, const __FlashStringHelper *v) {
+    key(k);
+    _out.print('"');
+    _out.print(v);
+    _out.print('"');
+  }
+
+  void beginObject(const __FlashStringHelper *k) {
+    key(k);
+    _out.print('{');
+    _first = true;
+  }
+
+  void endObject() {
+    _out.print('}');
+    _first = false;
+  }
+
+  void beginArray(const __FlashStringHelper *k) {
+    key(k);
+    _out.print('[');
+    _first = true;
+  }
+
+  template <typename T> void item(T v) {
+    if (!_first)
+      _out.print(',');
+    _first = false;
+    _out.print(v);
+  }
+
+  void endArray() {
+    _out.print(']');
+    _first = false;
+  }
+
+  void close() { _out.print('}'); }
+
+private:
+  Print &_out;
+  bool _first;
+
+  void key(const __FlashStringHelper *k) {
+    if (!_first)
+      _out.print(',');
+    _first = false;
+    _out.print('"');
+    _out.print(k);
+    _out.print(F("\":"));
+  }
+};
+
+#endif
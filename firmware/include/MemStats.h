@@ -0,0 +1,25 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <Arduino.h>
+
+// SRAM usage on the Mega (8 KB). Everything above .bss is painted with
+// STACK_CANARY before main() runs, so the deepest the stack has reached since
+// reset can be read back at any time. Sizes in bytes; the host build reports
+// zeros.
+#define STACK_CANARY 0xC5
+
+struct MemStats {
+  uint16_t staticBytes;     // .data + .bss
+  uint16_t heapBytes;       // __heap_start up to the heap break
+  uint16_t freeBytes;       // Heap break to current stack pointer
+  uint16_t stackPeak;       // High-water mark since reset
+  uint16_t stackHeadroom;   // Smallest heap-to-stack gap since reset
+  uint16_t heapFreeList;    // Freed heap blocks not returned to the break
+  uint16_t heapLargestFree; // Largest of those
+  uint8_t heapFragPct;      // 100 * (1 - largest / free list total)
+};
+
+void readMemStats(MemStats &stats);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef SENSOR_MANAGER_H
 #define SENSOR_MANAGER_H
 
+#include "ZoneConfig.h"
 #include "config.h"
 #include <Adafruit_ADS1X15.h>
 #include <Adafruit_MAX31855.h>
@@ -9,14 +10,10 @@
 #include <Wire.h>
 
 struct SensorData {
-  // Temperatures (Celsius)
-  float tempGasInternal;
-  float tempFeedstock;
-  float tempVaporizerWall;
-  float tempReactorInt1;
-  float tempReactorInt2;
-  float tempReactorExt1;
-  float tempReactorExt2;
+  unsigned long sampleMs; // millis() at the start of the scan
+
+  // Temperatures (Celsius), indexed by TcChannel
+  float temp[TC_COUNT];
 
   // Analog Sensors
   float pressureFeedBar;
@@ -25,24 +22,14 @@ struct SensorData {
   float h2ConcentrationPpm;
 
   // Status
-  // 0 = OK, Bit set = Fault
+  // 0 = OK, Bit set = Fault (see ERR_* in ZoneConfig.h). A faulted
+  // thermocouple reads NaN; one that is still being debounced reads its last
+  // good value.
   uint32_t sensorStatus;
-  bool sensorsHealthy; // aggregated simple flag
+  uint8_t tcCode[TC_COUNT]; // TC_CODE_* per TcChannel (see ZoneConfig.h)
+  bool sensorsHealthy; // No critical TC faulted without a healthy backup
 };
 
-// Error Bits
-#define ERR_TC_GAS_INTERNAL (1 << 0)
-#define ERR_TC_FEEDSTOCK (1 << 1)
-#define ERR_TC_VAPORIZER_WALL (1 << 2)
-#define ERR_TC_REACTOR_INT_1 (1 << 3)
-#define ERR_TC_REACTOR_INT_2 (1 << 4)
-#define ERR_TC_REACTOR_EXT_1 (1 << 5)
-#define ERR_TC_REACTOR_EXT_2 (1 << 6)
-#define ERR_P_FEED (1 << 7)
-#define ERR_P_REACTOR (1 << 8)
-#define ERR_MFC_FLOW (1 << 9)
-#define ERR_H2_SENSOR (1 << 10)
-
 class SensorManager {
 public:
   SensorManager();
@@ -51,14 +38,8 @@ public:
   SensorData getLastReadings();
 
 private:
-  // Thermocouple Objects
-  Adafruit_MAX31855 *_tcGasInternal;
-  Adafruit_MAX31855 *_tcFeedstock;
-  Adafruit_MAX31855 *_tcVaporizerWall;
-  Adafruit_MAX31855 *_tcReactorInt1;
-  Adafruit_MAX31855 *_tcReactorInt2;
-  Adafruit_MAX31855 *_tcReactorExt1;
-  Adafruit_MAX31855 *_tcReactorExt2;
+  // Thermocouple Objects, indexed by TcChannel
+  Adafruit_MAX31855 *_tc[TC_COUNT];
 
   // ADC Objects
   Adafruit_ADS1115 _adsMFC;
@@ -67,6 +48,16 @@ private:
 
   SensorData _currentData;
 
+  // Thermocouple fault debouncing, indexed by TcChannel
+  float _lastGood[TC_COUNT]; // NaN until the first good read
+  uint8_t _badReads[TC_COUNT];   // Consecutive, saturating
+  uint8_t _goodReads[TC_COUNT];  // Consecutive since faulting
+  uint8_t _agreeReads[TC_COUNT]; // Consecutive in step, until the check starts
+  uint8_t _faultCode[TC_COUNT];  // TC_CODE_* of the current bad streak
+  uint32_t _faulted;             // ERR_TC() bits
+
+  void readThermocouple(uint8_t ch);
+
   float readScaled(Adafruit_ADS1115 &ads, int channel, float vMin, float vMax,
                    float euMin, float euMax);
 };
@@ -1,9 +1,11 @@
 #ifndef SERIAL_COMMS_H
 #define SERIAL_COMMS_H
 
+#include "Crc16.h"
 #include "FlowController.h"
 #include "HeaterController.h"
 #include "SensorManager.h"
+#include "ZoneConfig.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
@@ -12,7 +14,10 @@ enum CommandType {
   CMD_SET_TEMP,
   CMD_SET_STATE,
   CMD_HEARTBEAT,
-  CMD_SET_FLOW
+  CMD_SET_FLOW,
+  CMD_SET_FF,
+  CMD_SET_DECOUPLE,
+  CMD_SET_PID
 };
 enum ControlState {
   STATE_STANDBY,
@@ -24,11 +29,21 @@ enum ControlState {
 
 struct Command {
   CommandType type;
-  int zone; // 0=Gas, 1=Vap, 2=Reactor
+  int zone; // Index into ZONES[]
   float value;
+  float value2; // SET_FF: per-degree gain (value is the base gain),
+                // SET_DECOUPLE: lag in s (value is the gain), SET_PID: ki
+  float value3; // SET_PID: kd (value is kp)
   int state;
+  uint32_t seq; // Host sequence number, 0 = unsequenced (no ack)
 };
 
+// Commands are short ({"cmd":"SET_TEMP","zone":3,"val":123.45,"seq":N}*XXXX
+// is under 64 bytes, "node" adds 9) and parsed in place, so the document only
+// needs slots for the members.
+#define CMD_BUFFER_SIZE 128
+#define CMD_DOC_SIZE JSON_OBJECT_SIZE(7)
+
 class SerialComms {
 public:
   SerialComms();
@@ -37,11 +52,35 @@ public:
   void sendTelemetry(const SensorData &sensors, HeaterController &heaters,
                      FlowController &flow, ControlState state,
                      unsigned long uptime);
-  void sendError(const String &msg);
+  void sendError(const __FlashStringHelper *msg,
+                 const __FlashStringHelper *zone = nullptr);
+
+  uint32_t getBaud() { return _baud; }
+  uint8_t getNode() { return _node; }
+  void setNode(uint8_t node) { _node = node; }
 
 private:
-  char _readBuffer[256];
-  int _bufIndex;
+  char _readBuffer[CMD_BUFFER_SIZE];
+  uint8_t _bufIndex;
+  bool _overflow;
+
+  // Link state. Frames are "<json>*XXXX" with a CRC-16 over the JSON text.
+  uint32_t _baud;
+  uint8_t _node;               // NODE_ID unless set otherwise
+  uint32_t _lastSeq;           // Last executed seq, retries are re-acked only
+  unsigned long _lastGoodFrame; // millis() of last frame that passed CRC
+  uint8_t _badFrames;           // Consecutive CRC/parse failures
+  uint32_t _telemetrySeq;       // "fseq", lets the host count dropped frames
+  bool _crcSeen;                // Checksummed frame seen: require them
+
+  bool verifyFrame(char *line);
+  void frameError(const __FlashStringHelper *msg);
+  void sendAck(uint32_t seq, uint32_t baud);
+  void sendPong(uint32_t seq);
+  void sendStats(uint32_t seq);
+  void endFrame(const CrcPrint &out);
+  void setBaud(uint32_t baud);
+  void checkLinkFallback();
 };
 
 #endif
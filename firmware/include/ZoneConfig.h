@@ -0,0 +1,88 @@
+#ifndef ZONE_CONFIG_H
+#define ZONE_CONFIG_H
+
+#include "config.h"
+
+// Channel and zone registry. The sensor scan, PID loops, safety rules and
+// telemetry encoding all iterate these tables, so adding a heater zone is a
+// matter of adding rows to src/ZoneConfig.cpp (plus pins in config.h) and the
+// matching entries in supervisory/app/config.py, which the log and benches
+// are generated from.
+//
+// The tables are defined once, in flash. Read their fields with pgm_read_*()
+// (pgm_read_byte(&ZONES[z].heaterPin)), never directly: on the AVR a plain
+// read of a PROGMEM address returns whatever SRAM holds there.
+
+// --- Thermocouple Channels ---
+// Enum order is the sensorStatus bit order (see ERR_TC()) and the order
+// channels appear in telemetry.
+enum TcChannel : uint8_t {
+  TC_GAS_INTERNAL,
+  TC_FEEDSTOCK,
+  TC_VAPORIZER_WALL,
+  TC_REACTOR_INT_1,
+  TC_REACTOR_INT_2,
+  TC_REACTOR_EXT_1,
+  TC_REACTOR_EXT_2,
+  TC_COUNT
+};
+
+#define TC_NONE 0xFF
+
+struct TcChannelDef {
+  uint8_t csPin;
+  PGM_P key;      // Telemetry key under "sensors", in flash
+  bool critical;  // A fault with no healthy backup clears sensorsHealthy
+                  // (-> STATE_FAULT)
+  float maxTempC; // Hard safety limit, 0 = unchecked
+  uint8_t backup; // TcChannel standing in once this one faults (PV and
+                  // maxTempC), TC_NONE if none
+};
+
+// Indexed by TcChannel
+extern const TcChannelDef TC_CHANNELS[TC_COUNT];
+
+// --- Heater Zones ---
+// Array index is the CMD_SET_TEMP zone number.
+#define ZONE_NONE 0xFF
+
+struct ZoneDef {
+  uint8_t heaterPin;
+  PGM_P key;           // Telemetry key under "heaters" and "sp", in flash
+  uint8_t pvPrimary;   // TcChannel feeding the PID
+  uint8_t pvSecondary; // Averaged with pvPrimary, TC_NONE if unused
+  int8_t filterSlot;   // WeightedAverage slot for the PV, -1 = raw PV
+  uint8_t ffInletTc;   // Inlet temperature for feedforward, TC_NONE = ambient
+  float ffBase;        // Feedforward per sccm (see config.h)
+  float ffPerK;        // Feedforward per sccm per degree of rise
+  uint8_t coupledZone; // Zone heating the same body, ZONE_NONE if none
+  float decoupleK;     // Decoupling gain for coupledZone (see config.h)
+};
+
+constexpr uint8_t ZONE_COUNT = 4;
+extern const ZoneDef ZONES[ZONE_COUNT];
+
+// Number of WeightedAverage buffers main.cpp allocates for smoothed PVs
+#define PV_FILTER_COUNT 2
+
+// --- Sensor Status Bits ---
+// Thermocouples occupy the low TC_COUNT bits (set once a channel has faulted,
+// see TC_FAULT_READS), analog sensors follow.
+#define ERR_TC(ch) (1UL << (ch))
+#define ERR_P_FEED (1UL << (TC_COUNT + 0))
+#define ERR_P_REACTOR (1UL << (TC_COUNT + 1))
+#define ERR_MFC_FLOW (1UL << (TC_COUNT + 2))
+#define ERR_H2_SENSOR (1UL << (TC_COUNT + 3))
+
+static_assert(TC_COUNT + 4 <= 32, "sensorStatus is a 32-bit mask");
+
+// --- Thermocouple Fault Codes ---
+// SensorData::tcCode, "tc_codes" in telemetry: per channel the MAX31855 fault
+// of its latest bad read. A code without the ERR_TC() bit is a fault still
+// being debounced.
+#define TC_CODE_NONE 0      // Bad read without a fault flag (SPI glitch, jump)
+#define TC_CODE_OPEN 1      // Thermocouple open circuit
+#define TC_CODE_SHORT_GND 2 // Thermocouple shorted to GND
+#define TC_CODE_SHORT_VCC 3 // Thermocouple shorted to VCC
+
+#endif
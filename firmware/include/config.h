@@ -4,7 +4,20 @@
 #include <Arduino.h>
 
 // --- Communications ---
-#define SERIAL_BAUD 115200
+#define SERIAL_BAUD 115200            // Boot and fallback rate
+#define SERIAL_BAUD_FAST 500000       // Negotiable via SET_BAUD (16U2 exact)
+#define SERIAL_BAUD_FASTEST 1000000   // Negotiable via SET_BAUD (16U2 exact)
+#define LINK_FALLBACK_TIMEOUT_MS 2000 // No good frame at a negotiated rate
+#define LINK_BAD_FRAME_LIMIT 3        // Consecutive CRC/parse failures
+
+// --- Node Addressing ---
+// Every frame sent carries "node". Commands with a "node" are only executed
+// by that node; NODE_BROADCAST is executed by every node and answered by none.
+// Commands without one are point to point and always executed.
+#ifndef NODE_ID
+#define NODE_ID 1 // 1-254, override with -D to tell controllers apart
+#endif
+#define NODE_BROADCAST 0
 
 // --- SPI Bus (MAX31855 Thermocouples) ---
 // Hardware SPI: SCK=52, MISO=50
@@ -47,7 +60,58 @@
 #define MAX_TEMP_C_REACTOR 800.0
 #define MAX_PRESSURE_BAR 10.0
 
+// --- Thermocouple Fault Filtering ---
+// A channel faults after TC_FAULT_READS consecutive bad reads and clears after
+// as many good ones; until then its last good reading stands in, so a single
+// EMI glitch neither reaches the PIDs nor trips STATE_FAULT. A read is bad if
+// the MAX31855 flags a fault or the value jumps more than TC_MAX_STEP_C per
+// read from the last good one (0 disables the jump check). The jump check
+// starts once TC_FAULT_READS reads in a row have agreed with each other.
+#define TC_FAULT_READS 3
+#define TC_MAX_STEP_C 25.0
+
+// --- Thermocouple Failover ---
+// A zone whose PV TC has faulted carries on on its backup (TC_CHANNELS[]
+// backup), the reactor wall TC for the internal one. The wall lags the
+// heater, so the zone is derated until the TC recovers: its heater output is
+// capped at TC_FAILOVER_DUTY_RATIO times its mean duty over the last
+// TC_FAILOVER_DUTY_AVG_S before the fault, and the channel's maxTempC is
+// checked against the backup TC_BACKUP_LIMIT_MARGIN_C lower. The cap follows
+// each zone's own load, so a zone holds the setpoint it held before the fault
+// but can't be driven much above it on the backup. The margin covers the
+// heater running up to ~115 C ahead of the wall at 400-600 C
+// (tests/bench_tc_faults.py); capping the output beats detuning the PID.
+#define TC_FAILOVER_DUTY_RATIO 1.3
+#define TC_FAILOVER_DUTY_AVG_S 300.0
+#define TC_BACKUP_LIMIT_MARGIN_C 125.0
+
+// --- Flow Feedforward (gas preheat and vaporizer) ---
+// Heater output added per sccm of flow setpoint, in ms of the WINDOW_SIZE
+// window: *_BASE is load independent of temperature (vaporization), *_PER_K
+// the load per degree C between the zone setpoint and its inlet. 0 disables;
+// SET_FF overrides them until reset.
+#define FF_GAS_BASE 0.0
+#define FF_GAS_PER_K 0.0
+#define FF_VAP_BASE 0.0
+#define FF_VAP_PER_K 0.0
+#define FF_AMBIENT_C 25.0 // Inlet temperature for zones without an inlet TC
+
+// --- Reactor Zone Decoupling ---
+// Reactor zones 1 and 2 heat the same tube, so each PID also sees the other
+// zone's heater. With a non-zero gain, a zone's heater output gets DECOUPLE_K_*
+// times the other zone's PID output added (negative: heat from the neighbour
+// means this zone needs less). Gains are the ratio of heater output changes in
+// a closed-loop setpoint step, see tests/bench_zone_coupling.py. The cross
+// term can be lagged to match the heat's travel time along the tube; 0 is
+// static decoupling. 0 gains disable; SET_DECOUPLE overrides until reset.
+#define DECOUPLE_K_REAC1 0.0 // Per unit of reactor 2's PID output
+#define DECOUPLE_K_REAC2 0.0 // Per unit of reactor 1's PID output
+#define DECOUPLE_LAG_S 0.0
+
 // --- Control Loop ---
 #define LOOP_INTERVAL_MS 100 // 10Hz Control Loop
+#ifndef TELEMETRY_INTERVAL_MS
+#define TELEMETRY_INTERVAL_MS 1000 // 1Hz, override with -D for benchmarks
+#endif
 
 #endif
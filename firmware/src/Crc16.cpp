@@ -0,0 +1,6 @@
+#include "Crc16.h"
+
+size_t CrcPrint::write(uint8_t c) {
+  crc = crc16Update(crc, c);
+  return _out.write(c);
+}
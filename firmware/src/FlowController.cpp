@@ -51,3 +51,7 @@ void FlowController::setEnabled(bool enabled) {
 }
 
 float FlowController::getSetpoint() { return currentSetpointSCCM; }
+
+float FlowController::getCommandedFlow() {
+  return _enabled ? currentSetpointSCCM : 0.0;
+}
@@ -1,112 +1,160 @@
 #include "HeaterController.h"
 
-HeaterController::HeaterController() {
-  // Initialize Variables
-  _spGas = 0;
-  _inGas = 0;
-  _outGas = 0;
-  _spVaporizer = 0;
-  _inVaporizer = 0;
-  _outVaporizer = 0;
-  _spReactor1 = 0;
-  _inReactor1 = 0;
-  _outReactor1 = 0;
-  _spReactor2 = 0;
-  _inReactor2 = 0;
-  _outReactor2 = 0;
+// Per-tick coefficient of a first-order lag with time constant lagS
+static float lagAlpha(float lagS) {
+  float dt = LOOP_INTERVAL_MS / 1000.0;
+  return lagS > 0 ? dt / (lagS + dt) : 1.0;
+}
 
+template <uint8_t N>
+HeaterBank<N>::HeaterBank(const ZoneDef *zones) : _zones(zones) {
   _enabled = false;
   _windowStartTime = millis();
 
   // P_ON_M specifies Proportional on Measurement (reduces overshoot) if
   // supported, but standard constructor is (&Input, &Output, &Setpoint, Kp, Ki,
   // Kd, Direction)
-  _pidGas = new PID(&_inGas, &_outGas, &_spGas, _kp, _ki, _kd, DIRECT);
-  _pidVaporizer = new PID(&_inVaporizer, &_outVaporizer, &_spVaporizer, _kp,
-                          _ki, _kd, DIRECT);
-  _pidReactor1 =
-      new PID(&_inReactor1, &_outReactor1, &_spReactor1, _kp, _ki, _kd, DIRECT);
-  _pidReactor2 =
-      new PID(&_inReactor2, &_outReactor2, &_spReactor2, _kp, _ki, _kd, DIRECT);
-}
-
-void HeaterController::begin() {
-  pinMode(PIN_HEATER_GAS, OUTPUT);
-  pinMode(PIN_HEATER_VAPORIZER, OUTPUT);
-  pinMode(PIN_HEATER_REACTOR_1, OUTPUT);
-  pinMode(PIN_HEATER_REACTOR_2, OUTPUT);
-
-  digitalWrite(PIN_HEATER_GAS, LOW);
-  digitalWrite(PIN_HEATER_VAPORIZER, LOW);
-  digitalWrite(PIN_HEATER_REACTOR_1, LOW);
-  digitalWrite(PIN_HEATER_REACTOR_2, LOW);
-
-  // Limit output to 0-WINDOW_SIZE (time proportional)
-  _pidGas->SetOutputLimits(0, WINDOW_SIZE);
-  _pidVaporizer->SetOutputLimits(0, WINDOW_SIZE);
-  _pidReactor1->SetOutputLimits(0, WINDOW_SIZE);
-  _pidReactor2->SetOutputLimits(0, WINDOW_SIZE);
-
-  _pidGas->SetMode(AUTOMATIC);
-  _pidVaporizer->SetMode(AUTOMATIC);
-  _pidReactor1->SetMode(AUTOMATIC);
-  _pidReactor2->SetMode(AUTOMATIC);
-}
-
-void HeaterController::setSetpoints(float spGas, float spVaporizer,
-                                    float spReactor1, float spReactor2) {
-  _spGas = spGas;
-  _spVaporizer = spVaporizer;
-  _spReactor1 = spReactor1;
-  _spReactor2 = spReactor2;
-}
-
-void HeaterController::setEnabled(bool enabled) {
+  for (uint8_t z = 0; z < N; z++) {
+    _sp[z] = 0;
+    _in[z] = 0;
+    _out[z] = 0;
+    _ffBase[z] = pgm_read_float(&zones[z].ffBase);
+    _ffPerK[z] = pgm_read_float(&zones[z].ffPerK);
+    _ff[z] = 0;
+    _dcK[z] = pgm_read_float(&zones[z].decoupleK);
+    _dcAlpha[z] = lagAlpha(DECOUPLE_LAG_S);
+    _dcX[z] = 0;
+    _duty[z] = 0;
+    _dutyAvg[z] = 0;
+    _derated[z] = false;
+    _pid[z] = new PID(&_in[z], &_out[z], &_sp[z], _kp, _ki, _kd, DIRECT);
+  }
+}
+
+template <uint8_t N> void HeaterBank<N>::begin() {
+  for (uint8_t z = 0; z < N; z++) {
+    uint8_t pin = pgm_read_byte(&_zones[z].heaterPin);
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+
+    // Limit output to 0-WINDOW_SIZE (time proportional)
+    _pid[z]->SetOutputLimits(0, WINDOW_SIZE);
+    _pid[z]->SetMode(AUTOMATIC);
+  }
+}
+
+template <uint8_t N> bool HeaterBank<N>::setSetpoint(uint8_t zone, float sp) {
+  if (zone >= N)
+    return false;
+  _sp[zone] = sp;
+  return true;
+}
+
+template <uint8_t N>
+bool HeaterBank<N>::setFeedforward(uint8_t zone, float base, float perK) {
+  if (zone >= N)
+    return false;
+  _ffBase[zone] = base;
+  _ffPerK[zone] = perK;
+  return true;
+}
+
+template <uint8_t N>
+bool HeaterBank<N>::setDecoupling(uint8_t zone, float k, float lagS) {
+  if (zone >= N || pgm_read_byte(&_zones[zone].coupledZone) == ZONE_NONE)
+    return false;
+  _dcK[zone] = k;
+  _dcAlpha[zone] = lagAlpha(lagS);
+  if (_enabled)
+    rebaseCoupled(zone);
+  return true;
+}
+
+// Bumpless gain change: re-solve the pair's PID outputs for the duty they
+// apply now (u = v + k * v_other) and restart the PIDs from there
+template <uint8_t N> void HeaterBank<N>::rebaseCoupled(uint8_t a) {
+  uint8_t b = pgm_read_byte(&_zones[a].coupledZone);
+  float det = 1 - _dcK[a] * _dcK[b];
+  if (det <= 0)
+    return;
+
+  float ua = _duty[a] - _ff[a], ub = _duty[b] - _ff[b];
+  _out[a] = (ua - _dcK[a] * ub) / det;
+  _out[b] = (ub - _dcK[b] * ua) / det;
+  _dcX[a] = _out[b];
+  _dcX[b] = _out[a];
+
+  // PID_v1 takes the current output as its integral on entering AUTOMATIC
+  _pid[a]->SetMode(MANUAL);
+  _pid[a]->SetMode(AUTOMATIC);
+  _pid[b]->SetMode(MANUAL);
+  _pid[b]->SetMode(AUTOMATIC);
+}
+
+template <uint8_t N>
+bool HeaterBank<N>::setTunings(uint8_t zone, float kp, float ki, float kd) {
+  if (zone >= N || kp < 0 || ki < 0 || kd < 0)
+    return false;
+  _pid[zone]->SetTunings(kp, ki, kd);
+  return true;
+}
+
+template <uint8_t N> void HeaterBank<N>::setDerated(uint8_t zone, bool derated) {
+  if (zone < N)
+    _derated[zone] = derated;
+}
+
+template <uint8_t N> void HeaterBank<N>::setEnabled(bool enabled) {
   _enabled = enabled;
   if (!enabled) {
     // Force outputs off immediately
-    digitalWrite(PIN_HEATER_GAS, LOW);
-    digitalWrite(PIN_HEATER_VAPORIZER, LOW);
-    digitalWrite(PIN_HEATER_REACTOR_1, LOW);
-    digitalWrite(PIN_HEATER_REACTOR_2, LOW);
+    allOff();
 
     // Reset PID integral terms? Usually good practice, or set mode to MANUAL.
     // For simplicity:
-    _pidGas->SetMode(MANUAL);
-    _pidVaporizer->SetMode(MANUAL);
-    _pidReactor1->SetMode(MANUAL);
-    _pidReactor2->SetMode(MANUAL);
-    _outGas = 0;
-    _outVaporizer = 0;
-    _outReactor1 = 0;
-    _outReactor2 = 0;
+    for (uint8_t z = 0; z < N; z++) {
+      _pid[z]->SetMode(MANUAL);
+      _out[z] = 0;
+      _ff[z] = 0;
+      _dcX[z] = 0;
+      _duty[z] = 0;
+    }
   } else {
-    _pidGas->SetMode(AUTOMATIC);
-    _pidVaporizer->SetMode(AUTOMATIC);
-    _pidReactor1->SetMode(AUTOMATIC);
-    _pidReactor2->SetMode(AUTOMATIC);
+    for (uint8_t z = 0; z < N; z++)
+      _pid[z]->SetMode(AUTOMATIC);
   }
 }
 
-void HeaterController::update(float tempGas, float tempVaporizer,
-                              float tempReactor1, float tempReactor2) {
+template <uint8_t N>
+void HeaterBank<N>::update(const float *pv, const float *tc, float flowSccm) {
   if (!_enabled) {
-    digitalWrite(PIN_HEATER_GAS, LOW);
-    digitalWrite(PIN_HEATER_VAPORIZER, LOW);
-    digitalWrite(PIN_HEATER_REACTOR_1, LOW);
-    digitalWrite(PIN_HEATER_REACTOR_2, LOW);
+    allOff();
     return;
   }
 
-  _inGas = tempGas;
-  _inVaporizer = tempVaporizer;
-  _inReactor1 = tempReactor1;
-  _inReactor2 = tempReactor2;
+  for (uint8_t z = 0; z < N; z++) {
+    ZONE_PROFILE_BEGIN(z);
+    _ff[z] = feedforward(z, tc, flowSccm);
+    _pid[z]->SetOutputLimits(-_ff[z], maxOutput(z) - _ff[z]);
+    _in[z] = pv[z];
+    _pid[z]->Compute();
+    ZONE_PROFILE_END(z);
+  }
 
-  _pidGas->Compute();
-  _pidVaporizer->Compute();
-  _pidReactor1->Compute();
-  _pidReactor2->Compute();
+  // After all PIDs have run, so coupled zones see each other's new output
+  float avgAlpha = lagAlpha(TC_FAILOVER_DUTY_AVG_S);
+  for (uint8_t z = 0; z < N; z++) {
+    ZONE_PROFILE_BEGIN(z);
+    _duty[z] = constrain(_out[z] + _ff[z] + decoupling(z), 0, maxOutput(z));
+    if (!_derated[z])
+      _dutyAvg[z] += avgAlpha * (_duty[z] - _dutyAvg[z]);
+    ZONE_PROFILE_END(z);
+  }
+}
+
+template <uint8_t N> void HeaterBank<N>::service() {
+  if (!_enabled)
+    return;
 
   // Time Proportional Logic
   unsigned long now = millis();
@@ -114,13 +162,46 @@ void HeaterController::update(float tempGas, float tempVaporizer,
     _windowStartTime += WINDOW_SIZE;
   }
 
-  applyTimeProportional(PIN_HEATER_GAS, _outGas);
-  applyTimeProportional(PIN_HEATER_VAPORIZER, _outVaporizer);
-  applyTimeProportional(PIN_HEATER_REACTOR_1, _outReactor1);
-  applyTimeProportional(PIN_HEATER_REACTOR_2, _outReactor2);
+  for (uint8_t z = 0; z < N; z++)
+    applyTimeProportional(pgm_read_byte(&_zones[z].heaterPin), _duty[z]);
+}
+
+// Cancels the heat the coupled zone's PID is putting into this zone
+template <uint8_t N> float HeaterBank<N>::decoupling(uint8_t zone) {
+  if (_dcK[zone] == 0)
+    return 0;
+  uint8_t other = pgm_read_byte(&_zones[zone].coupledZone);
+  _dcX[zone] += _dcAlpha[zone] * (_out[other] - _dcX[zone]);
+  return _dcK[zone] * _dcX[zone];
+}
+
+// Heat carried off by the flow: a fixed part per sccm plus a part per degree
+// the zone raises the stream above its inlet
+template <uint8_t N>
+float HeaterBank<N>::feedforward(uint8_t zone, const float *tc,
+                                 float flowSccm) const {
+  if (_ffBase[zone] == 0 && _ffPerK[zone] == 0)
+    return 0;
+
+  float inlet = FF_AMBIENT_C;
+  uint8_t inletTc = pgm_read_byte(&_zones[zone].ffInletTc);
+  if (inletTc != TC_NONE && !isnan(tc[inletTc]))
+    inlet = tc[inletTc];
+
+  float rise = _sp[zone] - inlet;
+  if (rise < 0)
+    rise = 0;
+  float ff = flowSccm * (_ffBase[zone] + _ffPerK[zone] * rise);
+  return constrain(ff, 0, WINDOW_SIZE);
+}
+
+template <uint8_t N> void HeaterBank<N>::allOff() {
+  for (uint8_t z = 0; z < N; z++)
+    digitalWrite(pgm_read_byte(&_zones[z].heaterPin), LOW);
 }
 
-void HeaterController::applyTimeProportional(int pin, double output) {
+template <uint8_t N>
+void HeaterBank<N>::applyTimeProportional(uint8_t pin, double output) {
   unsigned long now = millis();
   if (output > (now - _windowStartTime)) {
     digitalWrite(pin, HIGH);
@@ -128,3 +209,6 @@ void HeaterController::applyTimeProportional(int pin, double output) {
     digitalWrite(pin, LOW);
   }
 }
+
+// The firmware only ever uses the registry-sized bank
+template class HeaterBank<ZONE_COUNT>;
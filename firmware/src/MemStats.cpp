@@ -0,0 +1,65 @@
+#include "MemStats.h"
+
+#ifdef __AVR__
+
+extern char __data_start, __bss_end, __heap_start;
+extern char *__brkval;
+
+// avr-libc malloc free list (see stdlib_private.h)
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+// Runs from .init1, before the stack pointer and r1 are set up, so it is
+// plain assembly. Fills _end..RAMEND; .data/.bss are initialised later and
+// sit below _end.
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+  __asm volatile("    ldi r30, lo8(_end)\n"
+                 "    ldi r31, hi8(_end)\n"
+                 "    ldi r24, %0\n"
+                 "    ldi r25, hi8(__stack)\n"
+                 "    rjmp 2f\n"
+                 "1:  st Z+, r24\n"
+                 "2:  cpi r30, lo8(__stack)\n"
+                 "    cpc r31, r25\n"
+                 "    brlo 1b\n"
+                 "    breq 1b\n" ::"M"(STACK_CANARY));
+}
+
+void readMemStats(MemStats &stats) {
+  char *heapEnd = __brkval ? __brkval : &__heap_start;
+  char *sp = (char *)SP;
+
+  stats.staticBytes = &__bss_end - &__data_start;
+  stats.heapBytes = heapEnd - &__heap_start;
+  stats.freeBytes = sp - heapEnd;
+
+  // The first byte above the heap that lost its paint is the deepest the
+  // stack has been
+  const char *p = heapEnd;
+  while (p < sp && *(const uint8_t *)p == STACK_CANARY)
+    p++;
+  stats.stackHeadroom = p - heapEnd;
+  stats.stackPeak = (const char *)RAMEND - p + 1;
+
+  stats.heapFreeList = 0;
+  stats.heapLargestFree = 0;
+  for (struct __freelist *f = __flp; f != nullptr; f = f->nx) {
+    stats.heapFreeList += f->sz + sizeof(size_t);
+    if (f->sz > stats.heapLargestFree)
+      stats.heapLargestFree = f->sz;
+  }
+  stats.heapFragPct =
+      stats.heapFreeList == 0
+          ? 0
+          : 100 - (uint32_t)stats.heapLargestFree * 100 / stats.heapFreeList;
+}
+
+#else
+
+void readMemStats(MemStats &stats) { memset(&stats, 0, sizeof(stats)); }
+
+#endif
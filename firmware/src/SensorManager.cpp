@@ -1,34 +1,25 @@
 #include "SensorManager.h"
 
 SensorManager::SensorManager() {
-  _tcGasInternal = new Adafruit_MAX31855(PIN_SPI_CS_TC_GAS_INTERNAL);
-  _tcFeedstock = new Adafruit_MAX31855(PIN_SPI_CS_TC_FEEDSTOCK);
-  _tcVaporizerWall = new Adafruit_MAX31855(PIN_SPI_CS_TC_VAPORIZER_WALL);
-  _tcReactorInt1 = new Adafruit_MAX31855(PIN_SPI_CS_TC_REACTOR_INT_1);
-  _tcReactorInt2 = new Adafruit_MAX31855(PIN_SPI_CS_TC_REACTOR_INT_2);
-  _tcReactorExt1 = new Adafruit_MAX31855(PIN_SPI_CS_TC_REACTOR_EXT_1);
-  _tcReactorExt2 = new Adafruit_MAX31855(PIN_SPI_CS_TC_REACTOR_EXT_2);
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++) {
+    _tc[ch] = new Adafruit_MAX31855(pgm_read_byte(&TC_CHANNELS[ch].csPin));
+    _lastGood[ch] = NAN;
+    _badReads[ch] = 0;
+    _goodReads[ch] = 0;
+    _agreeReads[ch] = 0;
+    _faultCode[ch] = TC_CODE_NONE;
+  }
+  _faulted = 0;
 }
 
 void SensorManager::begin() {
   // Initialize SPI TCs - Library handles SPI begin internally but good practice
   // to ensure pin modes
-  pinMode(PIN_SPI_CS_TC_GAS_INTERNAL, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_FEEDSTOCK, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_VAPORIZER_WALL, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_REACTOR_INT_1, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_REACTOR_INT_2, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_REACTOR_EXT_1, OUTPUT);
-  pinMode(PIN_SPI_CS_TC_REACTOR_EXT_2, OUTPUT);
-
-  // Deselect all
-  digitalWrite(PIN_SPI_CS_TC_GAS_INTERNAL, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_FEEDSTOCK, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_VAPORIZER_WALL, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_REACTOR_INT_1, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_REACTOR_INT_2, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_REACTOR_EXT_1, HIGH);
-  digitalWrite(PIN_SPI_CS_TC_REACTOR_EXT_2, HIGH);
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++) {
+    uint8_t cs = pgm_read_byte(&TC_CHANNELS[ch].csPin);
+    pinMode(cs, OUTPUT);
+    digitalWrite(cs, HIGH); // Deselect
+  }
 
   // Initialize ADCs
   /* skipped for diagnostics
@@ -45,43 +36,20 @@ void SensorManager::begin() {
 }
 
 void SensorManager::update() {
+  _currentData.sampleMs = millis();
   _currentData.sensorStatus = 0;
 
-  // Read TCs and check for errors
-  _currentData.tempGasInternal = _tcGasInternal->readCelsius();
-  if (isnan(_currentData.tempGasInternal))
-    _currentData.sensorStatus |= ERR_TC_GAS_INTERNAL;
-
-  _currentData.tempFeedstock = _tcFeedstock->readCelsius();
-  if (isnan(_currentData.tempFeedstock))
-    _currentData.sensorStatus |= ERR_TC_FEEDSTOCK;
-
-  _currentData.tempVaporizerWall = _tcVaporizerWall->readCelsius();
-  if (isnan(_currentData.tempVaporizerWall))
-    _currentData.sensorStatus |= ERR_TC_VAPORIZER_WALL;
-
-  _currentData.tempReactorInt1 = _tcReactorInt1->readCelsius();
-  if (isnan(_currentData.tempReactorInt1))
-    _currentData.sensorStatus |= ERR_TC_REACTOR_INT_1;
-
-  _currentData.tempReactorInt2 = _tcReactorInt2->readCelsius();
-  if (isnan(_currentData.tempReactorInt2))
-    _currentData.sensorStatus |= ERR_TC_REACTOR_INT_2;
-
-  _currentData.tempReactorExt1 = _tcReactorExt1->readCelsius();
-  if (isnan(_currentData.tempReactorExt1))
-    _currentData.sensorStatus |= ERR_TC_REACTOR_EXT_1;
-
-  _currentData.tempReactorExt2 = _tcReactorExt2->readCelsius();
-  if (isnan(_currentData.tempReactorExt2))
-    _currentData.sensorStatus |= ERR_TC_REACTOR_EXT_2;
-
-  // Global health check based on critical sensors
-  if ((_currentData.sensorStatus & ERR_TC_GAS_INTERNAL) ||
-      (_currentData.sensorStatus & ERR_TC_REACTOR_INT_1)) {
-    _currentData.sensorsHealthy = false;
-  } else {
-    _currentData.sensorsHealthy = true;
+  // Read TCs and check for errors. A critical channel that has faulted drops
+  // the global health flag, unless its backup is still good.
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++)
+    readThermocouple(ch);
+
+  _currentData.sensorsHealthy = true;
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++) {
+    uint8_t backup = pgm_read_byte(&TC_CHANNELS[ch].backup);
+    if (pgm_read_byte(&TC_CHANNELS[ch].critical) && (_faulted & ERR_TC(ch)) &&
+        (backup == TC_NONE || (_faulted & ERR_TC(backup))))
+      _currentData.sensorsHealthy = false;
   }
 
   // --- Read ADCs with 0.5-4.5V scaling and Disconnect Detection ---
@@ -150,6 +118,57 @@ void SensorManager::update() {
 
 SensorData SensorManager::getLastReadings() { return _currentData; }
 
+// One MAX31855 read through the fault debouncer. The fault flags come from a
+// second read, so a glitch on the SPI lines shows as NaN without a code.
+void SensorManager::readThermocouple(uint8_t ch) {
+  float t = _tc[ch]->readCelsius();
+  bool good = !isnan(t);
+  uint8_t code = TC_CODE_NONE;
+  if (!good) {
+    uint8_t err = _tc[ch]->readError();
+    if (err & MAX31855_FAULT_OPEN)
+      code = TC_CODE_OPEN;
+    else if (err & MAX31855_FAULT_SHORT_GND)
+      code = TC_CODE_SHORT_GND;
+    else if (err & MAX31855_FAULT_SHORT_VCC)
+      code = TC_CODE_SHORT_VCC;
+  } else if (TC_MAX_STEP_C > 0) {
+    // The allowance grows with every read missed, so a channel coming back
+    // from a fault is judged against how far it could have moved meanwhile
+    bool close = !isnan(_lastGood[ch]) &&
+                 fabs(t - _lastGood[ch]) <= TC_MAX_STEP_C * (_badReads[ch] + 1);
+    // Until TC_FAULT_READS reads in a row agree there is no reference to
+    // judge against: a glitch on the first read after boot would otherwise
+    // fail every real read after it. A jump just restarts the count.
+    if (_agreeReads[ch] >= TC_FAULT_READS)
+      good = close;
+    else
+      _agreeReads[ch] = close ? _agreeReads[ch] + 1 : 1;
+  }
+
+  uint32_t bit = ERR_TC(ch);
+  if (good) {
+    _lastGood[ch] = t;
+    _badReads[ch] = 0;
+    if (!(_faulted & bit) || ++_goodReads[ch] >= TC_FAULT_READS) {
+      _faulted &= ~bit;
+      _faultCode[ch] = TC_CODE_NONE;
+    }
+  } else {
+    _goodReads[ch] = 0;
+    if (_badReads[ch] < 255)
+      _badReads[ch]++;
+    if (code != TC_CODE_NONE)
+      _faultCode[ch] = code;
+    if (_badReads[ch] >= TC_FAULT_READS)
+      _faulted |= bit;
+  }
+
+  _currentData.temp[ch] = (_faulted & bit) ? NAN : _lastGood[ch];
+  _currentData.tcCode[ch] = _faultCode[ch];
+  _currentData.sensorStatus |= _faulted & bit;
+}
+
 float SensorManager::readScaled(Adafruit_ADS1115 &ads, int channel, float vMin,
                                 float vMax, float euMin, float euMax) {
   int16_t adc = ads.readADC_SingleEnded(channel);
@@ -1,99 +1,320 @@
 #include "SerialComms.h"
+#include "JsonStream.h"
+#include "MemStats.h"
 
-SerialComms::SerialComms() { _bufIndex = 0; }
+SerialComms::SerialComms() {
+  _bufIndex = 0;
+  _overflow = false;
+  _baud = SERIAL_BAUD;
+  _node = NODE_ID;
+  _lastSeq = 0;
+  _lastGoodFrame = 0;
+  _badFrames = 0;
+  _telemetrySeq = 0;
+  _crcSeen = false;
+}
 
 void SerialComms::begin() {
   // Serial begin handled in main/setup usually, but we can ensure it here if
   // needed relying on global Serial
+  _baud = SERIAL_BAUD;
+  _lastGoodFrame = millis();
 }
 
 Command SerialComms::checkCommand() {
   Command cmd;
   cmd.type = CMD_NONE;
+  cmd.seq = 0;
+
+  checkLinkFallback();
 
   while (Serial.available()) {
     char c = Serial.read();
+    if (c == '\r')
+      continue;
     if (c == '\n') {
       _readBuffer[_bufIndex] = '\0';
       _bufIndex = 0;
 
+      if (_overflow) {
+        _overflow = false;
+        frameError(F("FRAME_OVERFLOW"));
+        continue;
+      }
+      if (!verifyFrame(_readBuffer)) {
+        frameError(F("CRC_ERROR"));
+        continue;
+      }
+
       // Parse JSON
-      StaticJsonDocument<256> doc;
+      StaticJsonDocument<CMD_DOC_SIZE> doc;
       DeserializationError error = deserializeJson(doc, _readBuffer);
 
       if (!error) {
-        const char *typeStr = doc["cmd"];
-        if (strcmp(typeStr, "SET_TEMP") == 0) {
+        _badFrames = 0;
+        _lastGoodFrame = millis();
+
+        // Another node's command is not for us, not even as a heartbeat.
+        // A broadcast is executed but never answered, as every node on the
+        // bus would answer at once.
+        int node = doc[F("node")] | (int)_node;
+        if (node != _node && node != NODE_BROADCAST)
+          continue;
+        bool broadcast = node == NODE_BROADCAST;
+
+        const char *typeStr = doc[F("cmd")] | "";
+        cmd.seq = broadcast ? 0 : doc[F("seq")] | 0UL;
+
+        // Clock sync: answer with our clock as close to receipt as possible.
+        // Stateless, so retries get a fresh timestamp rather than a re-ack.
+        if (strcmp_P(typeStr, PSTR("PING")) == 0) {
+          if (!broadcast)
+            sendPong(cmd.seq);
+          cmd.type = CMD_HEARTBEAT;
+          return cmd;
+        }
+
+        // Diagnostics, answered in the ack and likewise stateless
+        if (strcmp_P(typeStr, PSTR("GET_STATS")) == 0) {
+          if (!broadcast)
+            sendStats(cmd.seq);
+          cmd.type = CMD_HEARTBEAT;
+          return cmd;
+        }
+
+        // A retry of the command we just executed: ack again, but only let
+        // it refresh the watchdog.
+        if (cmd.seq != 0 && cmd.seq == _lastSeq) {
+          sendAck(cmd.seq, 0);
+          cmd.type = CMD_HEARTBEAT;
+          return cmd;
+        }
+
+        if (strcmp_P(typeStr, PSTR("SET_TEMP")) == 0) {
           cmd.type = CMD_SET_TEMP;
-          cmd.zone = doc["zone"];
-          cmd.value = doc["val"];
-        } else if (strcmp(typeStr, "SET_STATE") == 0) {
+          cmd.zone = doc[F("zone")];
+          cmd.value = doc[F("val")];
+        } else if (strcmp_P(typeStr, PSTR("SET_STATE")) == 0) {
           cmd.type = CMD_SET_STATE;
-          cmd.state = doc["state"];
-        } else if (strcmp(typeStr, "SET_FLOW") == 0) {
+          cmd.state = doc[F("state")];
+        } else if (strcmp_P(typeStr, PSTR("SET_FLOW")) == 0) {
           cmd.type = CMD_SET_FLOW;
-          cmd.value = doc["val"];
-        } else if (strcmp(typeStr, "HEARTBEAT") == 0) {
+          cmd.value = doc[F("val")];
+        } else if (strcmp_P(typeStr, PSTR("SET_FF")) == 0) {
+          cmd.type = CMD_SET_FF;
+          cmd.zone = doc[F("zone")];
+          cmd.value = doc[F("base")];
+          cmd.value2 = doc[F("per_k")];
+        } else if (strcmp_P(typeStr, PSTR("SET_DECOUPLE")) == 0) {
+          cmd.type = CMD_SET_DECOUPLE;
+          cmd.zone = doc[F("zone")];
+          cmd.value = doc[F("k")];
+          cmd.value2 = doc[F("lag")];
+        } else if (strcmp_P(typeStr, PSTR("SET_PID")) == 0) {
+          cmd.type = CMD_SET_PID;
+          cmd.zone = doc[F("zone")];
+          cmd.value = doc[F("kp")];
+          cmd.value2 = doc[F("ki")];
+          cmd.value3 = doc[F("kd")];
+        } else if (strcmp_P(typeStr, PSTR("HEARTBEAT")) == 0) {
           cmd.type = CMD_HEARTBEAT;
+        } else if (strcmp_P(typeStr, PSTR("SET_BAUD")) == 0) {
+          // Link-level: ack at the old rate, then switch. Reported to the
+          // main loop as a heartbeat.
+          uint32_t baud = doc[F("baud")];
+          if (baud == SERIAL_BAUD || baud == SERIAL_BAUD_FAST ||
+              baud == SERIAL_BAUD_FASTEST) {
+            if (!broadcast) {
+              _lastSeq = cmd.seq;
+              sendAck(cmd.seq, baud);
+            }
+            setBaud(baud);
+          } else if (!broadcast) {
+            sendError(F("INVALID_BAUD"));
+          }
+          cmd.type = CMD_HEARTBEAT;
+          return cmd;
+        }
+
+        if (cmd.seq != 0) {
+          _lastSeq = cmd.seq;
+          sendAck(cmd.seq, 0);
         }
         return cmd; // Return immediately on full command
       } else {
-        sendError("JSON Parse Error");
+        frameError(F("JSON Parse Error"));
       }
     } else {
-      if (_bufIndex < 255) {
+      if (_bufIndex < CMD_BUFFER_SIZE - 1) {
         _readBuffer[_bufIndex++] = c;
+      } else {
+        _overflow = true;
       }
     }
   }
   return cmd;
 }
 
+// Strips a trailing "*XXXX" checksum in place and verifies it. Frames
+// without one are accepted at SERIAL_BAUD until the first checksummed frame,
+// so a terminal can still be used for bench tests. After that, or at a
+// negotiated rate, they are rejected: line noise that eats the '*' must not
+// get a command executed unchecked (ArduinoJson ignores what trails the JSON).
+bool SerialComms::verifyFrame(char *line) {
+  char *star = strrchr(line, '*');
+  if (star == nullptr)
+    return !_crcSeen && _baud == SERIAL_BAUD;
+  if (strlen(star) != 5)
+    return false;
+
+  char *end;
+  uint16_t expected = strtoul(star + 1, &end, 16);
+  if (*end != '\0')
+    return false;
+
+  uint16_t crc = CRC16_INIT;
+  for (char *p = line; p < star; p++)
+    crc = crc16Update(crc, (uint8_t)*p);
+  *star = '\0';
+  if (crc != expected)
+    return false;
+  _crcSeen = true;
+  return true;
+}
+
+void SerialComms::frameError(const __FlashStringHelper *msg) {
+  if (_badFrames < 255)
+    _badFrames++;
+  sendError(msg);
+}
+
+void SerialComms::sendAck(uint32_t seq, uint32_t baud) {
+  CrcPrint out(Serial);
+  JsonStream json(out);
+  json.add(F("node"), _node);
+  json.add(F("ack"), seq);
+  if (baud != 0)
+    json.add(F("baud"), baud);
+  json.close();
+  endFrame(out);
+}
+
+void SerialComms::sendPong(uint32_t seq) {
+  CrcPrint out(Serial);
+  JsonStream json(out);
+  json.add(F("node"), _node);
+  json.add(F("ack"), seq);
+  json.add(F("t_ms"), millis());
+  json.close();
+  endFrame(out);
+}
+
+void SerialComms::sendStats(uint32_t seq) {
+  MemStats mem;
+  readMemStats(mem);
+
+  CrcPrint out(Serial);
+  JsonStream json(out);
+  json.add(F("node"), _node);
+  json.add(F("ack"), seq);
+  json.beginObject(F("mem"));
+  json.add(F("static"), mem.staticBytes);
+  json.add(F("heap"), mem.heapBytes);
+  json.add(F("free"), mem.freeBytes);
+  json.add(F("stack_peak"), mem.stackPeak);
+  json.add(F("stack_headroom"), mem.stackHeadroom);
+  json.add(F("heap_free_list"), mem.heapFreeList);
+  json.add(F("heap_largest_free"), mem.heapLargestFree);
+  json.add(F("heap_frag_pct"), mem.heapFragPct);
+  json.endObject();
+  json.close();
+  endFrame(out);
+}
+
+void SerialComms::setBaud(uint32_t baud) {
+  Serial.flush(); // Let the ack leave at the old rate
+  Serial.end();
+  Serial.begin(baud);
+  _baud = baud;
+  _bufIndex = 0;
+  _overflow = false;
+  _badFrames = 0;
+  _lastGoodFrame = millis();
+}
+
+// A negotiated rate must keep carrying good frames, otherwise drop back to
+// SERIAL_BAUD where the supervisor will look for us when it reconnects.
+void SerialComms::checkLinkFallback() {
+  if (_baud == SERIAL_BAUD)
+    return;
+  if (_badFrames >= LINK_BAD_FRAME_LIMIT ||
+      millis() - _lastGoodFrame > LINK_FALLBACK_TIMEOUT_MS) {
+    setBaud(SERIAL_BAUD);
+    sendError(F("BAUD_FALLBACK"));
+  }
+}
+
+// Completes a frame started on a CrcPrint with its "*XXXX" checksum
+void SerialComms::endFrame(const CrcPrint &out) {
+  char tail[6];
+  snprintf_P(tail, sizeof(tail), PSTR("*%04X"), out.crc);
+  Serial.println(tail);
+}
+
 void SerialComms::sendTelemetry(const SensorData &sensors,
                                 HeaterController &heaters, FlowController &flow,
                                 ControlState state, unsigned long uptime) {
-  StaticJsonDocument<512> doc;
+  CrcPrint out(Serial);
+  JsonStream json(out);
+  json.add(F("node"), _node);
 
-  doc["uptime"] = uptime;
-  doc["state"] = state;
+  json.add(F("uptime"), uptime);
+  json.add(F("t_ms"), sensors.sampleMs);
+  json.add(F("fseq"), ++_telemetrySeq);
+  json.add(F("state"), (int)state);
 
   // Sensors
-  JsonObject s = doc.createNestedObject("sensors");
-  s["t_gas"] = sensors.tempGasInternal;
-  s["t_feed"] = sensors.tempFeedstock;
-  s["t_vap"] = sensors.tempVaporizerWall;
-  s["t_r_i1"] = sensors.tempReactorInt1;
-  s["t_r_i2"] = sensors.tempReactorInt2;
-  s["t_r_e1"] = sensors.tempReactorExt1;
-  s["t_r_e2"] = sensors.tempReactorExt2;
-  s["p_feed"] = sensors.pressureFeedBar;
-  s["p_reac"] = sensors.pressureReactorBar;
-  s["flow"] = sensors.flowRateSccm;
-  s["h2"] = sensors.h2ConcentrationPpm;
-  s["status"] = sensors.sensorStatus;
-
-  // Heaters
-  JsonObject h = doc.createNestedObject("heaters");
-  h["gas"] = heaters.getOutputGas();
-  h["vap"] = heaters.getOutputVaporizer();
-  h["reac1"] = heaters.getOutputReactor1();
-  h["reac2"] = heaters.getOutputReactor2();
-
-  // Setpoints
-  JsonObject sp = doc.createNestedObject("sp");
-  sp["gas"] = heaters.getSetpointGas();
-  sp["vap"] = heaters.getSetpointVaporizer();
-  sp["reac1"] = heaters.getSetpointReactor1();
-  sp["reac2"] = heaters.getSetpointReactor2();
-  sp["flow"] = flow.getSetpoint();
-
-  serializeJson(doc, Serial);
-  Serial.println();
+  json.beginObject(F("sensors"));
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++)
+    json.add((const __FlashStringHelper *)pgm_read_ptr(&TC_CHANNELS[ch].key),
+             sensors.temp[ch]);
+  json.add(F("p_feed"), sensors.pressureFeedBar);
+  json.add(F("p_reac"), sensors.pressureReactorBar);
+  json.add(F("flow"), sensors.flowRateSccm);
+  json.add(F("h2"), sensors.h2ConcentrationPpm);
+  json.add(F("status"), sensors.sensorStatus);
+  json.beginArray(F("tc_codes"));
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++)
+    json.item(sensors.tcCode[ch]);
+  json.endArray();
+  json.endObject();
+
+  // Heaters and Setpoints
+  json.beginObject(F("heaters"));
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    json.add((const __FlashStringHelper *)pgm_read_ptr(&ZONES[z].key),
+             heaters.getOutput(z));
+  json.endObject();
+
+  json.beginObject(F("sp"));
+  for (uint8_t z = 0; z < ZONE_COUNT; z++)
+    json.add((const __FlashStringHelper *)pgm_read_ptr(&ZONES[z].key),
+             heaters.getSetpoint(z));
+  json.add(F("flow"), flow.getSetpoint());
+  json.endObject();
+
+  json.close();
+  endFrame(out);
 }
 
-void SerialComms::sendError(const String &msg) {
-  StaticJsonDocument<128> doc;
-  doc["error"] = msg;
-  serializeJson(doc, Serial);
-  Serial.println();
+void SerialComms::sendError(const __FlashStringHelper *msg,
+                             const __FlashStringHelper *zone) {
+  CrcPrint out(Serial);
+  JsonStream json(out);
+  json.add(F("node"), _node);
+  json.add(F("error"), msg);
+  if (zone != nullptr)
+    json.add(F("zone"), zone);
+  json.close();
+  endFrame(out);
 }
@@ -0,0 +1,71 @@
+#include "ZoneConfig.h"
+
+// The registry tables (see ZoneConfig.h). constexpr here so the checks below
+// can walk them at compile time; the extern declarations in the header give
+// them one definition, in flash, for the whole program.
+
+// Telemetry keys. Print them through a (const __FlashStringHelper *) cast of
+// the pointer read with pgm_read_ptr().
+static const char KEY_T_GAS[] PROGMEM = "t_gas";
+static const char KEY_T_FEED[] PROGMEM = "t_feed";
+static const char KEY_T_VAP[] PROGMEM = "t_vap";
+static const char KEY_T_R_I1[] PROGMEM = "t_r_i1";
+static const char KEY_T_R_I2[] PROGMEM = "t_r_i2";
+static const char KEY_T_R_E1[] PROGMEM = "t_r_e1";
+static const char KEY_T_R_E2[] PROGMEM = "t_r_e2";
+static const char KEY_ZONE_GAS[] PROGMEM = "gas";
+static const char KEY_ZONE_VAP[] PROGMEM = "vap";
+static const char KEY_ZONE_REAC1[] PROGMEM = "reac1";
+static const char KEY_ZONE_REAC2[] PROGMEM = "reac2";
+
+constexpr TcChannelDef TC_CHANNELS[TC_COUNT] PROGMEM = {
+    {PIN_SPI_CS_TC_GAS_INTERNAL, KEY_T_GAS, true, MAX_TEMP_C_GAS, TC_NONE},
+    {PIN_SPI_CS_TC_FEEDSTOCK, KEY_T_FEED, false, 0, TC_NONE},
+    {PIN_SPI_CS_TC_VAPORIZER_WALL, KEY_T_VAP, false, 0, TC_NONE},
+    {PIN_SPI_CS_TC_REACTOR_INT_1, KEY_T_R_I1, true, MAX_TEMP_C_REACTOR,
+     TC_REACTOR_EXT_1},
+    {PIN_SPI_CS_TC_REACTOR_INT_2, KEY_T_R_I2, false, 0, TC_REACTOR_EXT_2},
+    {PIN_SPI_CS_TC_REACTOR_EXT_1, KEY_T_R_E1, false, 0, TC_NONE},
+    {PIN_SPI_CS_TC_REACTOR_EXT_2, KEY_T_R_E2, false, 0, TC_NONE},
+};
+
+constexpr bool backupsValid(uint8_t ch) {
+  return ch == TC_COUNT ||
+         ((TC_CHANNELS[ch].backup == TC_NONE ||
+           (TC_CHANNELS[ch].backup < TC_COUNT &&
+            TC_CHANNELS[TC_CHANNELS[ch].backup].backup == TC_NONE)) &&
+          backupsValid(ch + 1));
+}
+static_assert(backupsValid(0),
+              "a TC_CHANNELS[] backup must be a channel without a backup");
+
+constexpr ZoneDef ZONES[] PROGMEM = {
+    {PIN_HEATER_GAS, KEY_ZONE_GAS, TC_GAS_INTERNAL, TC_NONE, -1, TC_NONE,
+     FF_GAS_BASE, FF_GAS_PER_K, ZONE_NONE, 0},
+    {PIN_HEATER_VAPORIZER, KEY_ZONE_VAP, TC_VAPORIZER_WALL, TC_NONE, -1,
+     TC_FEEDSTOCK, FF_VAP_BASE, FF_VAP_PER_K, ZONE_NONE, 0},
+    {PIN_HEATER_REACTOR_1, KEY_ZONE_REAC1, TC_REACTOR_INT_1, TC_REACTOR_EXT_1,
+     0, TC_NONE, 0, 0, 3, DECOUPLE_K_REAC1},
+    {PIN_HEATER_REACTOR_2, KEY_ZONE_REAC2, TC_REACTOR_INT_2, TC_REACTOR_EXT_2,
+     1, TC_NONE, 0, 0, 2, DECOUPLE_K_REAC2},
+};
+
+static_assert(sizeof(ZONES) / sizeof(ZONES[0]) == ZONE_COUNT,
+              "ZONE_COUNT in ZoneConfig.h must match the rows of ZONES[]");
+
+constexpr bool couplingSymmetric(uint8_t z) {
+  return z == ZONE_COUNT ||
+         ((ZONES[z].coupledZone == ZONE_NONE ||
+           (ZONES[z].coupledZone < ZONE_COUNT &&
+            ZONES[ZONES[z].coupledZone].coupledZone == z)) &&
+          couplingSymmetric(z + 1));
+}
+static_assert(couplingSymmetric(0),
+              "coupledZone in ZONES[] must pair zones both ways");
+
+constexpr uint8_t countFilterSlots(uint8_t z) {
+  return z == 0 ? 0
+                : countFilterSlots(z - 1) + (ZONES[z - 1].filterSlot >= 0);
+}
+static_assert(countFilterSlots(ZONE_COUNT) == PV_FILTER_COUNT,
+              "PV_FILTER_COUNT must match the smoothed zones in ZONES[]");
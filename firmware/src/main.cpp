@@ -2,16 +2,16 @@
 #include "SensorManager.h"
 #include "SerialComms.h"
 #include "WeightedAverage.h"
+#include "ZoneConfig.h"
 #include "config.h"
 #include <Arduino.h>
 
 // --- Global Objects ---
 SensorManager sensors;
-HeaterController heaters;
+HeaterController heaters(ZONES);
 FlowController flow;
 SerialComms comms;
-WeightedAverage wAvg1; // Zone 1
-WeightedAverage wAvg2; // Zone 2
+WeightedAverage pvFilters[PV_FILTER_COUNT]; // Smoothed zones (filterSlot)
 
 // --- State Management ---
 ControlState currentState = STATE_STANDBY;
@@ -25,12 +25,16 @@ const unsigned long HEARTBEAT_TIMEOUT = 5000; // 5 Seconds safety timeout
 // --- Forward Declarations ---
 void updateFSM(SensorData &data);
 void checkSafety(SensorData &data);
+void computeProcessValues(const SensorData &data, float *pv);
+void updateDerating(const SensorData &data);
+float tcReading(const SensorData &data, uint8_t ch);
+bool onBackup(const SensorData &data, uint8_t ch);
 
 void setup() {
   Serial.begin(SERIAL_BAUD);
   while (!Serial)
     delay(10); // Wait for USB
-  Serial.println("BOOT");
+  Serial.println(F("BOOT"));
 
   sensors.begin();
   heaters.begin();
@@ -54,22 +58,8 @@ void loop() {
 
     switch (cmd.type) {
     case CMD_SET_TEMP:
-      if (cmd.zone == 0)
-        heaters.setSetpoints(cmd.value, heaters.getSetpointVaporizer(),
-                             heaters.getSetpointReactor1(),
-                             heaters.getSetpointReactor2());
-      if (cmd.zone == 1)
-        heaters.setSetpoints(heaters.getSetpointGas(), cmd.value,
-                             heaters.getSetpointReactor1(),
-                             heaters.getSetpointReactor2());
-      if (cmd.zone == 2)
-        heaters.setSetpoints(heaters.getSetpointGas(),
-                             heaters.getSetpointVaporizer(), cmd.value,
-                             heaters.getSetpointReactor2());
-      if (cmd.zone == 3)
-        heaters.setSetpoints(heaters.getSetpointGas(),
-                             heaters.getSetpointVaporizer(),
-                             heaters.getSetpointReactor1(), cmd.value);
+      if (cmd.zone < 0 || !heaters.setSetpoint(cmd.zone, cmd.value))
+        comms.sendError(F("INVALID_ZONE"));
       break;
     case CMD_SET_STATE:
       currentState = (ControlState)cmd.state;
@@ -77,6 +67,21 @@ void loop() {
     case CMD_SET_FLOW:
       flow.setFlow(cmd.value);
       break;
+    case CMD_SET_FF:
+      if (cmd.zone < 0 ||
+          !heaters.setFeedforward(cmd.zone, cmd.value, cmd.value2))
+        comms.sendError(F("INVALID_ZONE"));
+      break;
+    case CMD_SET_DECOUPLE:
+      if (cmd.zone < 0 ||
+          !heaters.setDecoupling(cmd.zone, cmd.value, cmd.value2))
+        comms.sendError(F("INVALID_ZONE"));
+      break;
+    case CMD_SET_PID:
+      if (cmd.zone < 0 ||
+          !heaters.setTunings(cmd.zone, cmd.value, cmd.value2, cmd.value3))
+        comms.sendError(F("INVALID_ZONE"));
+      break;
     case CMD_HEARTBEAT:
       break;
     }
@@ -96,53 +101,55 @@ void loop() {
     // C. Update FSM (Logic for each state)
     updateFSM(data);
 
-    // Calc Weighted PVs (Simplest: 50/50 split of Int/Ext)
-    float instant1 = (data.tempReactorInt1 + data.tempReactorExt1) / 2.0;
-    float instant2 = (data.tempReactorInt2 + data.tempReactorExt2) / 2.0;
-
-    wAvg1.add(instant1);
-    wAvg2.add(instant2);
-
-    float pv1 = wAvg1.getAverage();
-    float pv2 = wAvg2.getAverage();
-
-    // D. Update Heaters (PID calculation)
-    heaters.update(data.tempGasInternal, data.tempVaporizerWall, pv1, pv2);
+    // D. Update Heaters (PID calculation plus flow feedforward)
+    float pv[ZONE_COUNT];
+    computeProcessValues(data, pv);
+    updateDerating(data);
+    heaters.update(pv, data.temp, flow.getCommandedFlow());
 
     // E. Telemetry (1Hz)
-    if (now - lastTelemetryTime >= 1000) {
+    if (now - lastTelemetryTime >= TELEMETRY_INTERVAL_MS) {
       lastTelemetryTime = now;
       comms.sendTelemetry(data, heaters, flow, currentState,
                           (now - startTime) / 1000);
     }
   }
 
-  // 3. Watchdog Check
+  // 3. SSR switching, every pass so duty isn't quantized to the 10Hz tick
+  heaters.service();
+
+  // 4. Watchdog Check
   if (now - lastHeartbeatTime > HEARTBEAT_TIMEOUT) {
     if (currentState != STATE_FAULT && currentState != STATE_ALARM &&
         currentState != STATE_STANDBY) {
       currentState = STATE_ALARM;
-      comms.sendError("HEARTBEAT_TIMEOUT");
+      comms.sendError(F("HEARTBEAT_TIMEOUT"));
     }
   }
 }
 
 void checkSafety(SensorData &data) {
   // Immediate overrides regardless of state
-  if (data.tempGasInternal > MAX_TEMP_C_GAS ||
-      data.tempReactorInt1 > MAX_TEMP_C_REACTOR ||
-      data.pressureReactorBar > MAX_PRESSURE_BAR) {
+  bool overLimit = data.pressureReactorBar > MAX_PRESSURE_BAR;
+  for (uint8_t ch = 0; ch < TC_COUNT; ch++) {
+    float maxTempC = pgm_read_float(&TC_CHANNELS[ch].maxTempC);
+    if (onBackup(data, ch))
+      maxTempC -= TC_BACKUP_LIMIT_MARGIN_C; // The backup lags the heater
+    if (maxTempC > 0 && tcReading(data, ch) > maxTempC)
+      overLimit = true;
+  }
 
+  if (overLimit) {
     if (currentState != STATE_FAULT) {
       currentState = STATE_FAULT;
-      comms.sendError("SAFETY_LIMIT_EXCEEDED");
+      comms.sendError(F("SAFETY_LIMIT_EXCEEDED"));
     }
   }
 
   if (!data.sensorsHealthy) {
     if (currentState != STATE_FAULT) {
       currentState = STATE_FAULT;
-      comms.sendError("SENSOR_FAILURE");
+      comms.sendError(F("SENSOR_FAILURE"));
     }
   }
 }
@@ -175,3 +182,55 @@ void updateFSM(SensorData &data) {
     break;
   }
 }
+
+void computeProcessValues(const SensorData &data, float *pv) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    uint8_t secondary = pgm_read_byte(&ZONES[z].pvSecondary);
+    int8_t filterSlot = (int8_t)pgm_read_byte(&ZONES[z].filterSlot);
+
+    // Simplest: 50/50 split of Int/Ext when a zone has two TCs. A faulted
+    // one drops out rather than turning the average into NaN.
+    float instant = tcReading(data, pgm_read_byte(&ZONES[z].pvPrimary));
+    if (secondary != TC_NONE) {
+      float second = tcReading(data, secondary);
+      if (isnan(instant))
+        instant = second;
+      else if (!isnan(second))
+        instant = (instant + second) / 2.0;
+    }
+
+    if (filterSlot >= 0) {
+      pvFilters[filterSlot].add(instant);
+      instant = pvFilters[filterSlot].getAverage();
+    }
+    pv[z] = instant;
+  }
+}
+
+// Zones whose PV comes (partly) from a backup TC are derated until it clears.
+// The supervisor is told when a zone fails over; sensorStatus shows the rest.
+void updateDerating(const SensorData &data) {
+  for (uint8_t z = 0; z < ZONE_COUNT; z++) {
+    uint8_t secondary = pgm_read_byte(&ZONES[z].pvSecondary);
+    bool derated = onBackup(data, pgm_read_byte(&ZONES[z].pvPrimary)) ||
+                   (secondary != TC_NONE && onBackup(data, secondary));
+    if (derated && !heaters.isDerated(z))
+      comms.sendError(F("TC_FAILOVER"),
+                      (const __FlashStringHelper *)pgm_read_ptr(&ZONES[z].key));
+    heaters.setDerated(z, derated);
+  }
+}
+
+// A thermocouple's reading, or its backup's once it has faulted (NaN if both
+// have)
+float tcReading(const SensorData &data, uint8_t ch) {
+  if (!onBackup(data, ch))
+    return data.temp[ch];
+  return data.temp[pgm_read_byte(&TC_CHANNELS[ch].backup)];
+}
+
+// Whether a thermocouple has faulted and its backup stands in for it
+bool onBackup(const SensorData &data, uint8_t ch) {
+  return (data.sensorStatus & ERR_TC(ch)) &&
+         pgm_read_byte(&TC_CHANNELS[ch].backup) != TC_NONE;
+}
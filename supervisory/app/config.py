@@ -1,4 +1,30 @@
 import os
+import re
+from typing import NamedTuple, Optional
+
+class ReactorConfig(NamedTuple):
+    name: str  # In URLs and table names
+    port: str
+    node: Optional[int]  # Controller NODE_ID, None for an unaddressed link
+
+def parse_reactors(spec: str, default_port: str) -> list:
+    # "name=port@node,..."; "@node" is optional. Empty: one reactor on
+    # default_port, unaddressed, as before there were several.
+    reactors = []
+    for item in filter(None, (s.strip() for s in spec.split(","))):
+        name, sep, port = item.partition("=")
+        if not sep or not re.fullmatch(r"[A-Za-z0-9_]+", name):
+            raise ValueError(f"REACTORS: expected name=port[@node], got {item!r}")
+        node = None
+        if "@" in port:
+            port, node = port.rsplit("@", 1)
+            if not (node.isdigit() and 1 <= int(node) <= 254):
+                raise ValueError(f"REACTORS: node must be 1-254 in {item!r}")
+            node = int(node)
+        if name in (r.name for r in reactors):
+            raise ValueError(f"REACTORS: {name} is listed twice")
+        reactors.append(ReactorConfig(name, port, node))
+    return reactors or [ReactorConfig("reactor1", default_port, None)]
 
 class Settings:
     import platform
@@ -14,7 +40,57 @@ class Settings:
              _default_port = "/dev/ttyACM0" # Fallback
     
     SERIAL_PORT: str = os.getenv("SERIAL_PORT", _default_port)
-    SERIAL_BAUD: int = 115200
-    DATABASE_URL: str = "sqlite:///./reactor_logs.db"
+    # One controller per reactor, "name=port@node,...". The first logs to
+    # process_log as a single-reactor supervisor does; unset is SERIAL_PORT.
+    REACTORS: list = parse_reactors(os.getenv("REACTORS", ""), SERIAL_PORT)
+    SERIAL_BAUD: int = 115200  # Boot/fallback rate (SERIAL_BAUD in firmware config.h)
+    # Rates to try via SET_BAUD after connecting, fastest first. Empty list keeps 115200.
+    SERIAL_BAUD_RATES: list = [int(b) for b in os.getenv("SERIAL_BAUD_RATES", "1000000,500000").split(",") if b]
+    LINK_FALLBACK_TIMEOUT_S: float = 2.0  # LINK_FALLBACK_TIMEOUT_MS in firmware
+    LINK_BAD_FRAME_LIMIT: int = 3
+    COMMAND_TIMEOUT_S: float = 0.5  # Wait for {"ack": seq} before retrying
+    COMMAND_RETRIES: int = 3
+    HEARTBEAT_INTERVAL_S: float = 1.0  # Firmware trips ALARM after 5 s of silence
+    RECONNECT_MIN_S: float = 0.5
+    RECONNECT_MAX_S: float = 30.0
+    DATABASE_URL: str = os.getenv("DATABASE_URL", "sqlite:///./reactor_logs.db")
+    LOG_QUEUE_ROWS: int = 2000  # Telemetry rows waiting for the DB writer; further rows are dropped
+    LOG_BATCH_ROWS: int = 50  # Commit once this many rows are waiting...
+    LOG_BATCH_INTERVAL_S: float = 1.0  # ...or this long after the oldest arrived
+    WS_QUEUE_FRAMES: int = 64  # Per /ws client; older frames are dropped when it falls behind
     
 settings = Settings()
+
+# Heater zones in firmware order: list index is the SET_TEMP zone number and
+# the name is the key under "heaters"/"sp" in telemetry. Must match ZONES[] in
+# firmware/src/ZoneConfig.cpp.
+ZONE_KEYS = ("gas", "vap", "reac1", "reac2")
+
+# Zone key -> zone heating the same body (ZONES[].coupledZone); only these
+# take SET_DECOUPLE
+COUPLED_ZONES = {"reac1": "reac2", "reac2": "reac1"}
+
+# Zone key -> thermocouple keys averaged into its PV (ZONES[].pvPrimary,
+# pvSecondary)
+ZONE_PV_TCS = {
+    "gas": ("t_gas",),
+    "vap": ("t_vap",),
+    "reac1": ("t_r_i1", "t_r_e1"),
+    "reac2": ("t_r_i2", "t_r_e2"),
+}
+
+# Zones the process gas passes through, which carry flow feedforward
+# (ZONES[].ffBase/ffPerK) -> the TC key of their inlet (ZONES[].ffInletTc),
+# None for ambient
+FLOW_ZONES = {"gas": None, "vap": "t_feed"}
+
+# Thermocouple telemetry keys (TC_CHANNELS[] in ZoneConfig.cpp) -> ProcessLog column
+TC_COLUMNS = {
+    "t_gas": "temp_gas",
+    "t_feed": "temp_feed",
+    "t_vap": "temp_vap",
+    "t_r_i1": "temp_r_i1",
+    "t_r_i2": "temp_r_i2",
+    "t_r_e1": "temp_r_e1",
+    "t_r_e2": "temp_r_e2",
+}
@@ -1,7 +1,9 @@
+from datetime import datetime, timezone
 from sqlalchemy.orm import Session
+from .config import TC_COLUMNS, ZONE_KEYS
 from .database import ProcessLog
 
-def create_log(db: Session, data: dict, uptime: float, state: int):
+def log_fields(data: dict, uptime: float, state: int) -> dict:
     # Map dictionary keys (from JSON) to Model fields
     # JSON keys: t_gas, t_feed... -> Model: temp_gas, temp_feed...
     
@@ -10,31 +12,34 @@ def create_log(db: Session, data: dict, uptime: float, state: int):
     h = data.get("heaters", {})
     sp = data.get("sp", {})
     
-    db_log = ProcessLog(
+    fields = dict(
         uptime=uptime,
         control_state=state,
-        
-        temp_gas=s.get("t_gas", 0.0),
-        temp_feed=s.get("t_feed", 0.0),
-        temp_vap=s.get("t_vap", 0.0),
-        temp_r_i1=s.get("t_r_i1", 0.0),
-        temp_r_i2=s.get("t_r_i2", 0.0),
-        temp_r_e1=s.get("t_r_e1", 0.0),
-        temp_r_e2=s.get("t_r_e2", 0.0),
+        controller_ms=data.get("t_ms"),
+        frame_seq=data.get("fseq"),
         
         pressure_feed=s.get("p_feed", 0.0),
         pressure_reac=s.get("p_reac", 0.0),
         flow_rate=s.get("flow", 0.0),
         h2_ppm=s.get("h2", 0.0),
-        
-        heater_gas=h.get("gas", 0.0),
-        heater_vap=h.get("vap", 0.0),
-        heater_reac=h.get("reac", 0.0),
-        
-        sp_gas=sp.get("gas", 0.0),
-        sp_vap=sp.get("vap", 0.0),
-        sp_reac=sp.get("reac", 0.0)
     )
+    for key, column in TC_COLUMNS.items():
+        fields[column] = s.get(key, 0.0)
+
+    # Per-zone heater duty and setpoint (heater_<zone>, sp_<zone>)
+    for zone in ZONE_KEYS:
+        fields[f"heater_{zone}"] = h.get(zone, 0.0)
+        fields[f"sp_{zone}"] = sp.get(zone, 0.0)
+    fields["sp_flow"] = sp.get("flow", 0.0)
+
+    # Sample time mapped to wall clock by the serial link; without it the
+    # column default (arrival time) applies
+    if data.get("ts") is not None:
+        fields["timestamp"] = datetime.fromtimestamp(data["ts"], timezone.utc).replace(tzinfo=None)
+    return fields
+
+def create_log(db: Session, data: dict, uptime: float, state: int):
+    db_log = ProcessLog(**log_fields(data, uptime, state))
     db.add(db_log)
     db.commit()
     return db_log
@@ -1,12 +1,23 @@
-from sqlalchemy import create_engine
+from sqlalchemy import Column, Float, Integer, Table, create_engine, event, inspect, text
 from sqlalchemy.orm import DeclarativeBase, Mapped, mapped_column, sessionmaker
 from datetime import datetime
-from .config import settings
+from typing import Optional
+from .config import settings, TC_COLUMNS, ZONE_KEYS
 
 # Database Setup
 engine = create_engine(settings.DATABASE_URL, connect_args={"check_same_thread": False})
 SessionLocal = sessionmaker(autocommit=False, autoflush=False, bind=engine)
 
+if engine.dialect.name == "sqlite":
+    @event.listens_for(engine, "connect")
+    def _sqlite_pragmas(dbapi_conn, _record):
+        # WAL lets API reads run while the log writer commits, and
+        # synchronous=NORMAL only syncs the WAL at checkpoints
+        cur = dbapi_conn.cursor()
+        cur.execute("PRAGMA journal_mode=WAL")
+        cur.execute("PRAGMA synchronous=NORMAL")
+        cur.close()
+
 class Base(DeclarativeBase):
     pass
 
@@ -16,37 +27,148 @@ class ProcessLog(Base):
     id: Mapped[int] = mapped_column(primary_key=True)
     timestamp: Mapped[datetime] = mapped_column(default=datetime.utcnow, index=True)
     uptime: Mapped[float] = mapped_column()
+
+    # Controller sample clock (millis()) and telemetry frame counter, for
+    # measuring true sample spacing and dropped frames after the fact
+    controller_ms: Mapped[Optional[int]] = mapped_column()
+    frame_seq: Mapped[Optional[int]] = mapped_column()
     
     # State
     control_state: Mapped[int] = mapped_column()
 
-    # Sensors - Temperatures
-    temp_gas: Mapped[float] = mapped_column()
-    temp_feed: Mapped[float] = mapped_column()
-    temp_vap: Mapped[float] = mapped_column()
-    temp_r_i1: Mapped[float] = mapped_column()
-    temp_r_i2: Mapped[float] = mapped_column()
-    temp_r_e1: Mapped[float] = mapped_column()
-    temp_r_e2: Mapped[float] = mapped_column()
-
     # Sensors - Analog
     pressure_feed: Mapped[float] = mapped_column()
     pressure_reac: Mapped[float] = mapped_column()
     flow_rate: Mapped[float] = mapped_column()
     h2_ppm: Mapped[float] = mapped_column()
 
-    # Actuators (Heater Duty Cycles)
-    heater_gas: Mapped[float] = mapped_column()
-    heater_vap: Mapped[float] = mapped_column()
-    heater_reac: Mapped[float] = mapped_column()
-
     # Setpoints
-    sp_gas: Mapped[float] = mapped_column()
-    sp_vap: Mapped[float] = mapped_column()
-    sp_reac: Mapped[float] = mapped_column()
+    sp_flow: Mapped[float] = mapped_column()  # MFC setpoint, sccm
+
+# Per-channel and per-zone columns, from the registry in config.py:
+# temp_<channel> (TC_COLUMNS), NULL while the thermocouple is faulted (the
+# controller sends null and the run may carry on on a backup TC), and
+# heater_<zone>/sp_<zone> heater duty and setpoint (ZONE_KEYS)
+for _column in TC_COLUMNS.values():
+    setattr(ProcessLog, _column, mapped_column(Float, nullable=True))
+for _zone in ZONE_KEYS:
+    setattr(ProcessLog, f"heater_{_zone}", mapped_column(Float, nullable=False))
+    setattr(ProcessLog, f"sp_{_zone}", mapped_column(Float, nullable=False))
+
+# History rollups: per bucket of ROLLUP_WIDTHS seconds, the sample count and
+# min/max/avg of every process value. Kept up to date by the log writer, so
+# /api/history never has to scan process_log for long time ranges.
+ROLLUP_WIDTHS = (1, 10, 60)
+ROLLUP_COLUMNS = tuple(c.name for c in ProcessLog.__table__.columns
+                       if isinstance(c.type, Float) and c.name != "uptime")
+ROLLUP_AGGS = ("min", "max", "avg")
+
+def _rollup_table(width: int, suffix: str = "") -> Table:
+    return Table(
+        f"process_rollup_{width}s{suffix}", Base.metadata,
+        Column("bucket", Integer, primary_key=True),  # Bucket start, epoch seconds (UTC)
+        Column("n", Integer, nullable=False),
+        *[Column(f"{c}_{agg}", Float) for c in ROLLUP_COLUMNS for agg in ROLLUP_AGGS],
+    )
+
+class LogTables:
+    """A reactor's process log and its history rollups.
+
+    The unsuffixed set is process_log and process_rollup_<w>s; other reactors
+    log to copies named process_log<suffix> and process_rollup_<w>s<suffix>.
+    """
+
+    def __init__(self, suffix: str = ""):
+        self.suffix = suffix
+        if suffix:
+            self.log = ProcessLog.__table__.to_metadata(Base.metadata, name=f"process_log{suffix}")
+        else:
+            self.log = ProcessLog.__table__
+        self.rollups = {width: _rollup_table(width, suffix) for width in ROLLUP_WIDTHS}
+
+LOG_TABLES = {}  # suffix -> LogTables; init_db() creates and migrates them all
+
+def log_tables(suffix: str = "") -> LogTables:
+    if suffix not in LOG_TABLES:
+        LOG_TABLES[suffix] = LogTables(suffix)
+    return LOG_TABLES[suffix]
+
+DEFAULT_TABLES = log_tables()
+ROLLUP_TABLES = DEFAULT_TABLES.rollups
+
+def _migrate_process_log(table: Table):
+    # Bring logs created by older versions up to the current columns.
+    # heater_reac/sp_reac (always 0.0, the firmware never sent "reac") become
+    # zone 1; any other missing column, e.g. a zone added to the registry, is
+    # added NULL or 0.0 for the rows already logged.
+    log = table.name
+    columns = {c["name"] for c in inspect(engine).get_columns(log)}
+    with engine.begin() as conn:
+        for old, new in (("heater_reac", "heater_reac1"), ("sp_reac", "sp_reac1")):
+            if old in columns and new not in columns:
+                conn.execute(text(f"ALTER TABLE {log} RENAME COLUMN {old} TO {new}"))
+                columns.add(new)
+        for c in table.columns:
+            if c.name not in columns:
+                ddl = c.type.compile(engine.dialect)
+                if not c.nullable:
+                    ddl += " NOT NULL DEFAULT 0"
+                conn.execute(text(f"ALTER TABLE {log} ADD COLUMN {c.name} {ddl}"))
+    _relax_not_null(table)
+
+def _relax_not_null(table: Table):
+    # Columns that became nullable (the TC temperatures) were NOT NULL in
+    # older logs. SQLite can't alter a constraint, so the log is rebuilt:
+    # renamed aside, created afresh with its indexes, and copied back.
+    log = table.name
+    insp = inspect(engine)
+    stored = {c["name"]: c["nullable"] for c in insp.get_columns(log)}
+    if not any(c.nullable and not stored.get(c.name, True) for c in table.columns):
+        return
+    names = ", ".join(c.name for c in table.columns)
+    with engine.begin() as conn:
+        for index in insp.get_indexes(log):
+            conn.execute(text(f"DROP INDEX {index['name']}"))
+        conn.execute(text(f"ALTER TABLE {log} RENAME TO {log}_migrating"))
+        table.create(conn)
+        conn.execute(text(f"INSERT INTO {log} ({names}) SELECT {names} FROM {log}_migrating"))
+        conn.execute(text(f"DROP TABLE {log}_migrating"))
+
+def _migrate_rollups(tables: LogTables):
+    # Rollup tables from before a process_log column was added get its
+    # aggregates, 0.0 like the column itself
+    existing = set(inspect(engine).get_table_names())
+    with engine.begin() as conn:
+        for table in tables.rollups.values():
+            if table.name not in existing:
+                continue
+            columns = {c["name"] for c in inspect(engine).get_columns(table.name)}
+            for c in table.columns:
+                if c.name not in columns:
+                    conn.execute(text(f"ALTER TABLE {table.name} ADD COLUMN {c.name} FLOAT DEFAULT 0.0"))
+
+def _backfill_rollups(tables: LogTables):
+    # Rollup tables created next to an existing log start out empty; build
+    # them from process_log once so older runs show up in /api/history
+    with engine.begin() as conn:
+        for width, table in tables.rollups.items():
+            if conn.execute(text(f"SELECT 1 FROM {table.name} LIMIT 1")).first():
+                continue
+            # By name: tables from older versions may order the columns
+            # differently from ROLLUP_COLUMNS
+            names = ", ".join(f"{c}_{agg}" for c in ROLLUP_COLUMNS for agg in ROLLUP_AGGS)
+            aggs = ", ".join(f"{agg}({c})" for c in ROLLUP_COLUMNS for agg in ROLLUP_AGGS)
+            conn.execute(text(
+                f"INSERT INTO {table.name} (bucket, n, {names}) "
+                f"SELECT CAST(strftime('%s', timestamp) AS INTEGER) / {width} * {width} AS b, count(*), {aggs} "
+                f"FROM {tables.log.name} GROUP BY b"))
 
 def init_db():
     Base.metadata.create_all(bind=engine)
+    for tables in LOG_TABLES.values():
+        _migrate_process_log(tables.log)
+        _migrate_rollups(tables)
+        _backfill_rollups(tables)
 
 def get_db():
     db = SessionLocal()
@@ -0,0 +1,144 @@
+import calendar
+import time
+from datetime import datetime, timezone
+from typing import Optional
+from sqlalchemy import Integer, case, cast, func, literal, select
+from sqlalchemy.dialects.sqlite import insert as sqlite_insert
+from .database import engine, DEFAULT_TABLES, ROLLUP_COLUMNS, ROLLUP_WIDTHS, LogTables
+
+
+def epoch(ts: datetime) -> float:
+    # process_log timestamps are naive UTC
+    return calendar.timegm(ts.timetuple()) + ts.microsecond / 1e6
+
+
+def _upsert(table):
+    # Merge a partial bucket into what is already stored for it. A column is
+    # NULL in a bucket that only saw a faulted TC; SQLite's two-argument
+    # min()/max() would return NULL, so each side falls back to the other.
+    stmt = sqlite_insert(table)
+    new, old = stmt.excluded, table.c
+    n = old.n + new.n
+    set_ = {"n": n}
+    for c in ROLLUP_COLUMNS:
+        lo, hi, avg = f"{c}_min", f"{c}_max", f"{c}_avg"
+        set_[lo] = func.min(func.coalesce(old[lo], new[lo]), func.coalesce(new[lo], old[lo]))
+        set_[hi] = func.max(func.coalesce(old[hi], new[hi]), func.coalesce(new[hi], old[hi]))
+        set_[avg] = func.coalesce((old[avg] * old.n + new[avg] * new.n) / n, old[avg], new[avg])
+    return stmt.on_conflict_do_update(index_elements=["bucket"], set_=set_)
+
+
+_UPSERTS = {}  # Rollup table -> its upsert, built on first use
+
+
+def _upsert_for(table):
+    stmt = _UPSERTS.get(table)
+    if stmt is None:
+        stmt = _UPSERTS[table] = _upsert(table)
+    return stmt
+
+
+def _merge(agg: dict, src: dict):
+    # Folds bucket src into agg (both {"n", "<col>_min/_max/_avg"}). None is
+    # a faulted TC and is skipped; the average stays weighted by n.
+    n = agg["n"] + src["n"]
+    for c in ROLLUP_COLUMNS:
+        lo, hi, avg = f"{c}_min", f"{c}_max", f"{c}_avg"
+        if src[avg] is None:
+            continue
+        if agg[avg] is None:
+            agg[lo], agg[hi], agg[avg] = src[lo], src[hi], src[avg]
+            continue
+        agg[lo] = min(agg[lo], src[lo])
+        agg[hi] = max(agg[hi], src[hi])
+        agg[avg] = (agg[avg] * agg["n"] + src[avg] * src["n"]) / n
+    agg["n"] = n
+
+
+def _sample_bucket(t: float, row: dict) -> dict:
+    # A single process_log row as a bucket of one
+    b = {"t": t, "n": 1}
+    for c in ROLLUP_COLUMNS:
+        b[f"{c}_min"] = b[f"{c}_max"] = b[f"{c}_avg"] = row[c]
+    return b
+
+
+def update_rollups(conn, rows, tables: LogTables = DEFAULT_TABLES):
+    """Folds freshly inserted process_log rows (log_fields dicts) into every rollup table."""
+    for width in ROLLUP_WIDTHS:
+        buckets = {}
+        for row in rows:
+            t = epoch(row["timestamp"])
+            bucket = int(t) // width * width
+            if bucket in buckets:
+                _merge(buckets[bucket], _sample_bucket(t, row))
+            else:
+                buckets[bucket] = _sample_bucket(t, row)
+        values = []
+        for bucket, agg in buckets.items():
+            agg.pop("t")
+            agg["bucket"] = bucket
+            values.append(agg)
+        conn.execute(_upsert_for(tables.rollups[width]), values)
+
+
+def _binned(series, t, n, lo, hi, avg, t_from: float, bin_s: float, points: int):
+    # Min/max decimation: groups rows into `points` equal time bins. The
+    # min/max envelope keeps every excursion visible however far the range is
+    # zoomed out; avg is weighted by sample count, over the rows that have
+    # the column (NULL: faulted TC). t, n and the per-column lo/hi/avg
+    # expressions describe one row as a bucket.
+    bin_ = func.min(cast((t - t_from) / bin_s, Integer), points - 1).label("bin")
+    cols = [func.min(t).label("t"), func.sum(n).label("n")]
+    for c in series:
+        cols += [(func.sum(avg[c] * n) / func.sum(case((avg[c].is_not(None), n)))).label(c),
+                 func.min(lo[c]).label(f"{c}_min"), func.max(hi[c]).label(f"{c}_max")]
+    return select(*cols), bin_
+
+
+def load_history(t_from: Optional[float], t_to: Optional[float], points: int,
+                 series=ROLLUP_COLUMNS, tables: LogTables = DEFAULT_TABLES) -> dict:
+    """Process values (series, ProcessLog column names) from t_from to t_to
+    (epoch s) reduced to at most `points` points.
+
+    Uses the coarsest rollup that still has a bucket per point, or process_log
+    itself when the range is shorter than `points` seconds. Missing t_to is
+    now; missing t_from is the first logged sample.
+    """
+    if t_to is None:
+        t_to = time.time()
+    with engine.connect() as conn:
+        if t_from is None:
+            first = conn.execute(select(func.min(tables.log.c.timestamp))).scalar()
+            if first is None:
+                return {"from": None, "to": t_to, "resolution_s": None, "points": []}
+            t_from = epoch(first)
+        if t_to <= t_from:
+            return {"from": t_from, "to": t_to, "resolution_s": None, "points": []}
+
+        bin_s = (t_to - t_from) / points
+        width = max((w for w in ROLLUP_WIDTHS if w <= bin_s), default=0)
+        if width:
+            c = tables.rollups[width].c
+            query, bin_ = _binned(series, c.bucket, c.n, {k: c[f"{k}_min"] for k in series},
+                                  {k: c[f"{k}_max"] for k in series},
+                                  {k: c[f"{k}_avg"] for k in series}, t_from, bin_s, points)
+            query = query.where(c.bucket >= int(t_from) // width * width, c.bucket < t_to)
+        else:
+            c = tables.log.c
+            since = datetime.fromtimestamp(t_from, timezone.utc).replace(tzinfo=None)
+            until = datetime.fromtimestamp(t_to, timezone.utc).replace(tzinfo=None)
+            values = {k: c[k] for k in series}
+            t = (func.julianday(c.timestamp) - 2440587.5) * 86400.0  # Epoch seconds in SQLite
+            query, bin_ = _binned(series, t, literal(1), values, values, values, t_from, bin_s, points)
+            query = query.where(c.timestamp >= since, c.timestamp < until)
+        rows = conn.execute(query.group_by(bin_).order_by(bin_)).mappings().all()
+
+    points_out = []
+    for row in rows:
+        p = {"t": round(row["t"], 3), "n": row["n"]}
+        for k in series:
+            for name in (k, f"{k}_min", f"{k}_max"):
+                p[name] = None if row[name] is None else round(row[name], 4)
+        points_out.append(p)
+    return {"from": t_from, "to": t_to, "resolution_s": width, "points": points_out}
@@ -0,0 +1,155 @@
+import logging
+import queue
+import threading
+import time
+from collections import deque
+from datetime import datetime
+from sqlalchemy import insert
+from sqlalchemy.exc import DataError, IntegrityError
+from .config import settings
+from .crud import log_fields
+from .database import engine, DEFAULT_TABLES, LogTables
+from .history import update_rollups
+
+logger = logging.getLogger("log_writer")
+
+
+def _percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, round(p / 100.0 * (len(values) - 1)))]
+
+
+class LogWriter:
+    """Writes telemetry rows to a reactor's process log from its own thread.
+
+    The event loop only converts the frame to a row and queues it. The thread
+    inserts whatever has queued up as one executemany, folds it into the
+    history rollups in the same transaction, and commits when
+    LOG_BATCH_ROWS rows are waiting or LOG_BATCH_INTERVAL_S after the oldest
+    one arrived. When the queue is full, new rows are dropped and counted
+    rather than stalling telemetry. A batch the database rejects for its
+    data is retried row by row, so only the offending rows are lost.
+    """
+
+    LATENCY_WINDOW = 200  # Batches kept for the write latency percentiles
+
+    def __init__(self, tables: LogTables = DEFAULT_TABLES, name: str = "log-writer"):
+        self.tables = tables
+        self.name = name
+        self._queue = queue.Queue(maxsize=settings.LOG_QUEUE_ROWS)
+        self._thread = None
+        self._stopping = threading.Event()
+        self._write_ms = deque(maxlen=self.LATENCY_WINDOW)
+        self._row_age_ms = deque(maxlen=self.LATENCY_WINDOW)
+        self.stats = {
+            "rows_written": 0,
+            "rows_dropped": 0,  # Queue full
+            "rows_lost": 0,  # Rejected, or in a batch that failed to write
+            "batches": 0,
+            "write_errors": 0,
+            "queue_max": 0,  # Deepest the queue has been
+        }
+
+    def start(self):
+        if self._thread is not None:
+            return
+        self._stopping.clear()
+        self._thread = threading.Thread(target=self._run, name=self.name, daemon=True)
+        self._thread.start()
+
+    def stop(self, timeout: float = 5.0):
+        # Writes out what is still queued before returning
+        if self._thread is None:
+            return
+        self._stopping.set()
+        self._thread.join(timeout)
+        self._thread = None
+
+    def submit(self, data: dict, uptime: float, state: int) -> bool:
+        row = log_fields(data, uptime, state)
+        # Every row of an executemany needs the same columns, so the
+        # arrival time fills in for frames without a sample time
+        row.setdefault("timestamp", datetime.utcnow())
+        try:
+            self._queue.put_nowait((time.monotonic(), row))
+        except queue.Full:
+            self.stats["rows_dropped"] += 1
+            return False
+        depth = self._queue.qsize()
+        if depth > self.stats["queue_max"]:
+            self.stats["queue_max"] = depth
+        return True
+
+    def get_stats(self) -> dict:
+        write_ms, row_age_ms = list(self._write_ms), list(self._row_age_ms)
+        return dict(
+            self.stats,
+            queue_depth=self._queue.qsize(),
+            queue_size=self._queue.maxsize,
+            write_p50_ms=_percentile(write_ms, 50),
+            write_p99_ms=_percentile(write_ms, 99),
+            write_max_ms=max(write_ms) if write_ms else None,
+            # Oldest row of a batch: arrival -> committed
+            row_age_p99_ms=_percentile(row_age_ms, 99),
+        )
+
+    def _run(self):
+        batch = []
+        while True:
+            if batch:
+                timeout = batch[0][0] + settings.LOG_BATCH_INTERVAL_S - time.monotonic()
+            else:
+                timeout = settings.LOG_BATCH_INTERVAL_S
+            try:
+                batch.append(self._queue.get(timeout=max(0.0, timeout)))
+                while len(batch) < settings.LOG_BATCH_ROWS:
+                    batch.append(self._queue.get_nowait())
+            except queue.Empty:
+                pass
+
+            stopping = self._stopping.is_set()
+            due = batch and (len(batch) >= settings.LOG_BATCH_ROWS
+                             or time.monotonic() - batch[0][0] >= settings.LOG_BATCH_INTERVAL_S)
+            if batch and (due or stopping):
+                self._write(batch)
+                batch = []
+            if stopping and self._queue.empty():
+                return
+
+    def _insert(self, rows):
+        with engine.begin() as conn:
+            conn.execute(insert(self.tables.log), rows)
+            update_rollups(conn, rows, self.tables)
+
+    def _write(self, batch):
+        t0 = time.monotonic()
+        rows = [row for _, row in batch]
+        written = len(rows)
+        try:
+            self._insert(rows)
+        except (IntegrityError, DataError) as e:
+            # One bad frame fails the whole executemany; keep the rest
+            logger.warning(f"DB Log ({self.tables.log.name}): batch rejected, retrying row by row: {e}")
+            written = 0
+            for row in rows:
+                try:
+                    self._insert([row])
+                    written += 1
+                except Exception as row_e:
+                    self.stats["write_errors"] += 1
+                    self.stats["rows_lost"] += 1
+                    logger.error(f"DB Log Error ({self.tables.log.name}): {row_e}")
+        except Exception as e:
+            self.stats["write_errors"] += 1
+            self.stats["rows_lost"] += len(batch)
+            logger.error(f"DB Log Error ({self.tables.log.name}): {e}")
+            return
+        if not written:
+            return
+        t1 = time.monotonic()
+        self._write_ms.append(round((t1 - t0) * 1000.0, 2))
+        self._row_age_ms.append(round((t1 - batch[0][0]) * 1000.0, 2))
+        self.stats["rows_written"] += written
+        self.stats["batches"] += 1
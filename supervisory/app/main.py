@@ -1,17 +1,23 @@
-from fastapi import FastAPI, WebSocket, WebSocketDisconnect, HTTPException
+from fastapi import APIRouter, Depends, FastAPI, WebSocket, WebSocketDisconnect, HTTPException, Query
 from fastapi.staticfiles import StaticFiles
 from contextlib import asynccontextmanager
-from typing import List
-from .orchestrator import orchestrator
-from .database import engine, Base
+from typing import List, Optional
+import asyncio
+from .reactors import Reactor, reactors, default_reactor, start_all, stop_all
+from .history import load_history
+from .ws_hub import Client
+from .database import engine, Base, ROLLUP_COLUMNS
+from .config import COUPLED_ZONES, ZONE_KEYS
 
 @asynccontextmanager
 async def lifespan(app: FastAPI):
     # Startup
-    await orchestrator.start()
+    await start_all()
     yield
     # Shutdown
-    # orchestrator.stop()
+    await stop_all()
+
+MAX_HISTORY_POINTS = 5000
 
 app = FastAPI(title="Reactor Controller", lifespan=lifespan)
 
@@ -25,40 +31,140 @@ app.add_middleware(
 )
 
 # --- API Endpoints ---
+# Per reactor, under /api/reactors/{reactor}/... and, for the reactor given
+# by ?reactor= or else the first one, under /api/...
+
+def find_reactor(reactor: Optional[str]) -> Optional[Reactor]:
+    return default_reactor if reactor is None else reactors.get(reactor)
+
+def get_reactor(reactor: Optional[str] = None) -> Reactor:
+    found = find_reactor(reactor)
+    if found is None:
+        raise HTTPException(status_code=404, detail=f"unknown reactor: {reactor}")
+    return found
+
+api = APIRouter()
 
-@app.post("/api/control/state/{state_id}")
-async def set_state(state_id: int):
+@app.get("/api/reactors")
+async def list_reactors():
+    # Configured reactors (REACTORS), their controller node and link state
+    return [r.summary() for r in reactors.values()]
+
+@api.post("/control/state/{state_id}")
+async def set_state(state_id: int, r: Reactor = Depends(get_reactor)):
     # 0=Standby, 1=Warmup, 2=Working, etc.
-    await orchestrator.set_state(state_id)
-    return {"status": "command_sent", "state": state_id}
+    acked = await r.orchestrator.set_state(state_id)
+    return {"status": "command_sent", "state": state_id, "acked": acked}
+
+@api.post("/control/setpoint")
+async def set_setpoint(zone: int, value: float, rate: float = 0.0, r: Reactor = Depends(get_reactor)):
+    # Zone: index into ZONE_KEYS (0=Gas, 1=Vap, 2=Reactor 1, 3=Reactor 2)
+    if not 0 <= zone < len(ZONE_KEYS):
+        raise HTTPException(status_code=400, detail=f"zone must be 0-{len(ZONE_KEYS) - 1}")
+    acked = await r.orchestrator.send_setpoint(zone, value, rate)
+    return {"status": "command_sent", "zone": zone, "value": value, "rate": rate, "acked": acked}
+
+@api.post("/control/flow")
+async def set_flow(value: float, r: Reactor = Depends(get_reactor)):
+    acked = await r.orchestrator.send_flow(value)
+    return {"status": "command_sent", "value": value, "acked": acked}
+
+@api.post("/control/feedforward")
+async def set_feedforward(zone: int, base: float = 0.0, per_k: float = 0.0, r: Reactor = Depends(get_reactor)):
+    # Heater output per sccm of flow (base) and per sccm per degree C of rise
+    # over the inlet (per_k), in ms of the 1 s SSR window. 0/0 disables.
+    if not 0 <= zone < len(ZONE_KEYS):
+        raise HTTPException(status_code=400, detail=f"zone must be 0-{len(ZONE_KEYS) - 1}")
+    acked = await r.orchestrator.send_feedforward(zone, base, per_k)
+    return {"status": "command_sent", "zone": zone, "base": base, "per_k": per_k, "acked": acked}
+
+@api.post("/control/decoupling")
+async def set_decoupling(zone: int, k: float = 0.0, lag: float = 0.0, r: Reactor = Depends(get_reactor)):
+    # Added to the zone's heater output per unit of the coupled reactor zone's
+    # PID output (k, usually negative), through a lag in seconds. 0 disables.
+    coupled = [i for i, key in enumerate(ZONE_KEYS) if key in COUPLED_ZONES]
+    if zone not in coupled:
+        raise HTTPException(status_code=400, detail=f"only zones {coupled} are coupled")
+    acked = await r.orchestrator.send_decoupling(zone, k, lag)
+    return {"status": "command_sent", "zone": zone, "k": k, "lag": lag, "acked": acked}
+
+@api.post("/control/pid")
+async def set_pid(zone: int, kp: float, ki: float, kd: float = 0.0, r: Reactor = Depends(get_reactor)):
+    # Zone PID tunings, per degree C of error in ms of the 1 s SSR window
+    if not 0 <= zone < len(ZONE_KEYS):
+        raise HTTPException(status_code=400, detail=f"zone must be 0-{len(ZONE_KEYS) - 1}")
+    if min(kp, ki, kd) < 0:
+        raise HTTPException(status_code=400, detail="tunings must not be negative")
+    acked = await r.orchestrator.send_tunings(zone, kp, ki, kd)
+    return {"status": "command_sent", "zone": zone, "kp": kp, "ki": ki, "kd": kd, "acked": acked}
+
+@api.get("/link")
+async def get_link_stats(r: Reactor = Depends(get_reactor)):
+    # Frame loss, CRC errors, PING round trip and controller clock offset
+    return r.link.get_stats()
+
+@api.get("/log/stats")
+async def get_log_stats(r: Reactor = Depends(get_reactor)):
+    # DB writer queue depth, dropped rows and batch write latency
+    return r.log_writer.get_stats()
+
+@api.get("/ws/stats")
+async def get_ws_stats(r: Reactor = Depends(get_reactor)):
+    # Per /ws client: queue depth, frames sent and dropped, send lag
+    return r.ws_hub.get_stats()
+
+@api.get("/controller/stats")
+async def get_controller_stats(r: Reactor = Depends(get_reactor)):
+    # Controller SRAM: static, heap, stack high-water mark, heap fragmentation
+    mem = await r.link.get_controller_stats()
+    if mem is None:
+        raise HTTPException(status_code=503, detail="controller not reachable")
+    return {"mem": mem}
 
-@app.post("/api/control/setpoint")
-async def set_setpoint(zone: int, value: float, rate: float = 0.0):
-    # Zone: 0=Gas, 1=Vap, 2=Reactor
-    await orchestrator.send_setpoint(zone, value, rate)
-    return {"status": "command_sent", "zone": zone, "value": value, "rate": rate}
+@api.get("/live")
+async def get_live(r: Reactor = Depends(get_reactor)):
+    # Last MAX_BUFFER_SIZE telemetry frames as received
+    return list(r.orchestrator.live_buffer)
 
-@app.post("/api/control/flow")
-async def set_flow(value: float):
-    await orchestrator.send_flow(value)
-    return {"status": "command_sent", "value": value}
+@api.get("/history")
+async def get_history(start: Optional[float] = Query(None, alias="from"), to: Optional[float] = None,
+                      points: int = 500, series: Optional[str] = None, r: Reactor = Depends(get_reactor)):
+    # Logged process values between from and to (epoch s), min/max/avg per
+    # point. series: comma-separated process_log columns, default all.
+    if not 2 <= points <= MAX_HISTORY_POINTS:
+        raise HTTPException(status_code=400, detail=f"points must be 2-{MAX_HISTORY_POINTS}")
+    columns = tuple(series.split(",")) if series else ROLLUP_COLUMNS
+    unknown = [c for c in columns if c not in ROLLUP_COLUMNS]
+    if unknown:
+        raise HTTPException(status_code=400, detail=f"unknown series: {', '.join(unknown)}")
+    return await asyncio.to_thread(load_history, start, to, points, columns, r.tables)
 
-@app.get("/api/history")
-async def get_history():
-    return list(orchestrator.live_buffer)
+app.include_router(api, prefix="/api")
+app.include_router(api, prefix="/api/reactors/{reactor}")
 
 # --- WebSocket ---
 
 @app.websocket("/ws")
-async def websocket_endpoint(websocket: WebSocket):
+@app.websocket("/ws/{reactor}")
+async def websocket_endpoint(websocket: WebSocket, reactor: Optional[str] = None,
+                             policy: str = "drop_oldest", delta: bool = False):
+    # One reactor's telemetry, /ws/{reactor} or /ws?reactor= (default the
+    # first). policy: drop_oldest (every frame while keeping up) or latest
+    # (skip to the newest). delta=true sends only changed values after the
+    # first frame.
+    r = find_reactor(reactor)
+    if r is None or policy not in Client.POLICIES:
+        await websocket.close(code=1008)
+        return
     await websocket.accept()
-    queue = await orchestrator.subscribe()
+    client = r.ws_hub.subscribe(f"{websocket.client.host}:{websocket.client.port}", policy, delta)
     try:
         while True:
-            data = await queue.get()
-            await websocket.send_json(data)
+            await websocket.send_text(await client.next())
     except WebSocketDisconnect:
-        orchestrator.unsubscribe(queue)
+        pass
+    finally:
+        r.ws_hub.unsubscribe(client)
 
 # --- Static Files ---
 import os
@@ -1,8 +1,9 @@
 import asyncio
 from collections import deque
-from .serial_interface import serial_link
-from .database import SessionLocal, init_db
-from .crud import create_log
+from .serial_interface import SerialInterface
+from .log_writer import LogWriter
+from .ws_hub import WebSocketHub
+from .config import ZONE_KEYS
 import logging
 
 logger = logging.getLogger("orchestrator")
@@ -11,19 +12,26 @@ logger = logging.getLogger("orchestrator")
 MAX_BUFFER_SIZE = 300
 
 class Orchestrator:
-    def __init__(self):
+    # Ramps, live buffer, logging and /ws fan-out for one reactor's link
+    def __init__(self, link: SerialInterface, log_writer: LogWriter, ws_hub: WebSocketHub):
+        self.link = link
+        self.log_writer = log_writer
+        self.ws_hub = ws_hub
         self.live_buffer = deque(maxlen=MAX_BUFFER_SIZE)
         self.latest_state = {}
         self.ramps = {} # {zone: {target: float, rate_per_sec: float, last_update: float}}
-        self.subscribers = set() # WebSocket queues
 
     async def start(self):
-        # Initialize DB
-        init_db()
-        
+        # The database must be initialized (init_db) first
+        self.log_writer.start()
+
         # Connect Serial
-        serial_link.set_telemetry_callback(self.handle_telemetry)
-        await serial_link.connect()
+        self.link.set_telemetry_callback(self.handle_telemetry)
+        await self.link.connect()
+
+    async def stop(self):
+        # Flush queued log rows without blocking the loop
+        await asyncio.to_thread(self.log_writer.stop)
 
     async def handle_telemetry(self, data: dict):
         try:
@@ -36,8 +44,7 @@ class Orchestrator:
                 ramp = self.ramps[zone]
                 # get current SP from telemetry to ensure we don't drift
                 # map zone index to telemetry key
-                keys = ["gas", "vap", "reac1", "reac2"]
-                current_sp = data.get("sp", {}).get(keys[zone], 0.0)
+                current_sp = data.get("sp", {}).get(ZONE_KEYS[zone], 0.0)
                 
                 target = ramp["target"]
                 rate = ramp["rate_per_sec"]
@@ -70,37 +77,24 @@ class Orchestrator:
             self.latest_state = data
             self.live_buffer.append(data)
             
-            # 3. Log to Database (Sync wrapper for now, SQLite is fast enough)
-            # Ideally use run_in_executor for heavy DB ops
-            try:
-                uptime = data.get("uptime", 0)
-                state = data.get("state", 0)
-                
-                # Create a new session for this operation
-                with SessionLocal() as db:
-                    create_log(db, data, uptime, state)
-                    
-            except Exception as e:
-                logger.error(f"DB Log Error: {e}")
-
-            # 4. Broadcast to WebSockets
-            for q in list(self.subscribers):
-                try:
-                    await q.put(data)
-                except Exception:
-                    self.subscribers.remove(q)
-            print(f"Orchestrator: Processed telemetry. Buffer size: {len(self.live_buffer)}") # DEBUG
+            # 3. Log to Database (queued; the writer thread batches the inserts)
+            self.log_writer.submit(data, data.get("uptime", 0), data.get("state", 0))
+
+            # 4. Broadcast to WebSockets (encoded once, queued per client)
+            self.ws_hub.publish(data)
+            # Every frame of every reactor: lazy formatting, off unless DEBUG
+            logger.debug("Processed telemetry, buffer size %d", len(self.live_buffer))
         except Exception as e:
             logger.error(f"Error in handle_telemetry: {e}")
-            print(f"CRITICAL ORCHESTRATOR ERROR: {e}")
 
-    async def send_command_setpoint(self, zone: int, value: float):
-         await serial_link.send_command({"cmd": "SET_TEMP", "zone": zone, "val": value})
+    async def send_command_setpoint(self, zone: int, value: float) -> bool:
+        return await self.link.send_command({"cmd": "SET_TEMP", "zone": zone, "val": value})
 
-    async def send_flow(self, value: float):
-        await serial_link.send_command({"cmd": "SET_FLOW", "val": value})
+    async def send_flow(self, value: float) -> bool:
+        return await self.link.send_command({"cmd": "SET_FLOW", "val": value})
 
-    async def send_setpoint(self, zone: int, value: float, rate_min: float = 0.0):
+    async def send_setpoint(self, zone: int, value: float, rate_min: float = 0.0) -> bool:
+        # Returns whether the controller acked; ramps report True once queued
         import time
         if rate_min > 0:
             # Start Ramp
@@ -109,24 +103,30 @@ class Orchestrator:
                 "rate_per_sec": rate_min / 60.0,
                 "last_update": time.time()
             }
+            return True
         else:
             # Immediate
             if zone in self.ramps: del self.ramps[zone]
-            await self.send_command_setpoint(zone, value)
-
-    async def set_state(self, state: int):
-        await serial_link.send_command({"cmd": "SET_STATE", "state": state})
-
-    async def subscribe(self):
-        q = asyncio.Queue()
-        # Send history first
-        for item in self.live_buffer:
-            await q.put(item)
-        self.subscribers.add(q)
-        return q
-
-    def unsubscribe(self, q):
-        if q in self.subscribers:
-            self.subscribers.remove(q)
-
-orchestrator = Orchestrator()
+            return await self.send_command_setpoint(zone, value)
+
+    async def send_feedforward(self, zone: int, base: float, per_k: float) -> bool:
+        # Flow feedforward gains (firmware config.h FF_*); 4 significant
+        # digits keeps the command well inside the controller's 128-byte RX
+        # buffer (CMD_BUFFER_SIZE) once seq, node and the checksum are added
+        return await self.link.send_command({"cmd": "SET_FF", "zone": zone,
+                                             "base": float(f"{base:.4g}"),
+                                             "per_k": float(f"{per_k:.4g}")})
+
+    async def send_decoupling(self, zone: int, k: float, lag: float) -> bool:
+        # Reactor zone decoupling (firmware config.h DECOUPLE_*)
+        return await self.link.send_command({"cmd": "SET_DECOUPLE", "zone": zone,
+                                             "k": float(f"{k:.4g}"),
+                                             "lag": float(f"{lag:.4g}")})
+
+    async def send_tunings(self, zone: int, kp: float, ki: float, kd: float) -> bool:
+        return await self.link.send_command({"cmd": "SET_PID", "zone": zone,
+                                             "kp": float(f"{kp:.4g}"), "ki": float(f"{ki:.4g}"),
+                                             "kd": float(f"{kd:.4g}")})
+
+    async def set_state(self, state: int) -> bool:
+        return await self.link.send_command({"cmd": "SET_STATE", "state": state})
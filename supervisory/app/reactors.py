@@ -0,0 +1,52 @@
+import asyncio
+from .config import settings, ReactorConfig
+from .database import init_db, log_tables
+from .log_writer import LogWriter
+from .orchestrator import Orchestrator
+from .serial_interface import SerialInterface
+from .ws_hub import WebSocketHub
+
+
+class Reactor:
+    """Everything the supervisor keeps per controller: its serial link,
+    orchestrator, log tables with their writer thread, and /ws hub.
+
+    Reactors share nothing but the database file and the event loop, so a
+    slow or disconnected controller only stalls its own link.
+    """
+
+    def __init__(self, cfg: ReactorConfig, primary: bool):
+        self.name = cfg.name
+        self.node = cfg.node
+        # The first reactor keeps the unsuffixed tables, so a log written
+        # before there were several carries on as its history
+        self.tables = log_tables("" if primary else f"_{cfg.name}")
+        self.link = SerialInterface(cfg.port, cfg.node, f"serial_link.{cfg.name}")
+        self.log_writer = LogWriter(self.tables, f"log-writer-{cfg.name}")
+        self.ws_hub = WebSocketHub()
+        self.orchestrator = Orchestrator(self.link, self.log_writer, self.ws_hub)
+
+    def summary(self) -> dict:
+        latest = self.orchestrator.latest_state
+        return {
+            "name": self.name,
+            "port": self.link.port,
+            "node": self.node,
+            "connected": self.link.connected,
+            "state": latest.get("state"),
+            "log_table": self.tables.log.name,
+        }
+
+
+reactors = {cfg.name: Reactor(cfg, i == 0) for i, cfg in enumerate(settings.REACTORS)}
+default_reactor = next(iter(reactors.values()))
+
+
+async def start_all():
+    init_db()
+    for reactor in reactors.values():
+        await reactor.orchestrator.start()
+
+
+async def stop_all():
+    await asyncio.gather(*(r.orchestrator.stop() for r in reactors.values()))
@@ -1,71 +1,380 @@
 import asyncio
+import binascii
 import json
 import logging
+import random
+import time
 import serial_asyncio
+from collections import deque
 from typing import Callable, Optional
 from .config import settings
 
-logger = logging.getLogger("serial_link")
 
-class SerialInterface:
+def frame(payload: str) -> str:
+    # "<json>*XXXX" with CRC-16/CCITT-FALSE, same as firmware Crc16.h
+    crc = binascii.crc_hqx(payload.encode("utf-8"), 0xFFFF)
+    return f"{payload}*{crc:04X}"
+
+def unframe(line: str, required: bool = False):
+    # Returns (payload, crc_ok). Lines without a '*' are passed through
+    # unless a checksum is required; a '*' not followed by exactly 4 hex
+    # digits (truncated, or noise) fails like a bad checksum.
+    star = line.rfind("*")
+    if star < 0:
+        return line, not required
+    payload = line[:star]
+    tail = line[star + 1:]
+    if len(tail) != 4 or not all(c in "0123456789abcdefABCDEF" for c in tail):
+        return payload, False
+    return payload, binascii.crc_hqx(payload.encode("utf-8"), 0xFFFF) == int(tail, 16)
+
+class ClockSync:
+    # NTP-style mapping from controller millis() to host wall time. Every
+    # PING yields (host send, controller t_ms, host receive); the sample with
+    # the lowest round trip is the least distorted by USB/asyncio queueing,
+    # so its offset is the one applied.
+    WINDOW = 16
+    REBOOT_STEP_MS = 5000  # t_ms going back further than this = controller reset
+
     def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.samples = deque(maxlen=self.WINDOW)  # (rtt_ms, offset_s)
+        self._last_ms = None
+        self._wraps = 0
+
+    def unwrap(self, t_ms: int) -> int:
+        # millis() is 32-bit and wraps after ~49.7 days
+        if self._last_ms is not None and t_ms < self._last_ms - self.REBOOT_STEP_MS:
+            if self._last_ms > 2**32 - 600_000 and t_ms < 600_000:
+                self._wraps += 1
+            else:
+                self.reset()
+            self._last_ms = t_ms
+        elif self._last_ms is None or t_ms > self._last_ms:
+            self._last_ms = t_ms
+        return t_ms + self._wraps * 2**32
+
+    def add(self, t_send: float, t_ms: int, t_recv: float):
+        ctrl_s = self.unwrap(t_ms) / 1000.0
+        self.samples.append(((t_recv - t_send) * 1000.0, (t_send + t_recv) / 2.0 - ctrl_s))
+
+    @property
+    def best(self):
+        return min(self.samples) if self.samples else None
+
+    def to_wall(self, t_ms: int) -> Optional[float]:
+        best = self.best
+        if best is None:
+            return None
+        return self.unwrap(t_ms) / 1000.0 + best[1]
+
+class SerialInterface:
+    """The link to one controller on `port`.
+
+    With a node, commands are addressed to it and frames from any other node
+    are dropped; without one the link is point to point and takes everything.
+    """
+
+    def __init__(self, port: str, node: Optional[int] = None, name: str = "serial_link"):
+        self.port = port
+        self.node = node
+        self.logger = logging.getLogger(name)
         self.reader = None
         self.writer = None
         self.running = False
+        self.connected = False
+        self.baud = settings.SERIAL_BAUD
         self.telemetry_callback: Optional[Callable[[dict], None]] = None
 
+        # Random start so a restarted supervisor doesn't collide with the
+        # firmware's last executed seq (which it would treat as a retry).
+        self._seq = random.randint(1, 2**31)
+        self._pending = {}  # seq -> Future resolved by {"ack": seq}
+        self._cmd_lock = asyncio.Lock()
+        self._bad_frames = 0
+        self._bad_bauds = set()  # Rates that fell back on CRC errors this run
+        self._link_task = None
+
+        self.clock = ClockSync()
+        self._last_fseq = None
+        self._last_sample_ms = None
+        self.stats = {
+            "frames": 0,
+            "frames_dropped": 0,  # Gaps in telemetry "fseq"
+            "crc_errors": 0,
+            "foreign_frames": 0,  # Good frames from another node
+            "connects": 0,
+            "rtt_ms": None,  # Best PING round trip in the sync window
+            "clock_offset_s": None,  # wall time = t_ms / 1000 + offset
+            "sample_interval_ms": None,  # Controller-side spacing of the last two frames
+            "latency_ms": None,  # Sample time -> arrival, last frame
+        }
+
+    @property
+    def is_socket(self) -> bool:
+        return self.port.startswith("socket://")
+
     async def connect(self):
-        try:
-            if settings.SERIAL_PORT.startswith("socket://"):
-                # Handle socket literal for testing
-                host_port = settings.SERIAL_PORT.replace("socket://", "")
-                host, port = host_port.split(":")
-                self.reader, self.writer = await asyncio.open_connection(host, int(port))
-            else:
-                self.reader, self.writer = await serial_asyncio.open_serial_connection(
-                    url=settings.SERIAL_PORT, baudrate=settings.SERIAL_BAUD
-                )
-            logger.info(f"Connected to {settings.SERIAL_PORT}")
-            self.running = True
-            asyncio.create_task(self._read_loop())
-        except Exception as e:
-            logger.error(f"Failed to connect to serial: {e}")
-            # Retry logic could go here
+        # Returns immediately; the link task keeps (re)connecting with backoff.
+        self.running = True
+        if self._link_task is None:
+            self._link_task = asyncio.create_task(self._link_loop())
 
-    async def _read_loop(self):
+    async def close(self):
+        self.running = False
+        self._drop_link()
+        if self._link_task:
+            self._link_task.cancel()
+            self._link_task = None
+
+    async def _link_loop(self):
+        backoff = settings.RECONNECT_MIN_S
         while self.running:
+            read_task = heartbeat_task = None
             try:
-                line = await self.reader.readline()
-                if line:
-                    decoded = line.decode('utf-8', errors='ignore').strip()
-                    print(f"RAW SERIAL: {decoded}") # DEBUG
-                    
-                    try:
-                        data = json.loads(decoded)
-                        if "uptime" in data or "state" in data:
-                             if self.telemetry_callback:
-                                 await self.telemetry_callback(data)
-                        elif "error" in data:
-                            print(f"FIRMWARE ERROR: {data['error']}")
-                            logger.error(f"FIRMWARE ERROR: {data['error']}")
-                    except json.JSONDecodeError:
-                        print(f"Malformed JSON: {decoded}")
-                        logger.warning(f"Malformed JSON: {line}")
+                await self._open()
+                read_task = asyncio.create_task(self._read_loop())
+                await self._negotiate()
+                self.connected = True
+                self.stats["connects"] += 1
+                backoff = settings.RECONNECT_MIN_S
+                self.logger.info(f"Link up on {self.port} at {self.baud} baud")
+
+                heartbeat_task = asyncio.create_task(self._heartbeat_loop())
+                await read_task  # Returns when the link drops
+            except asyncio.CancelledError:
+                raise
             except Exception as e:
-                print(f"Serial read error: {e}")
-                logger.error(f"Serial read error: {e}")
-                await asyncio.sleep(1)
+                self.logger.error(f"Serial link error: {e}")
+            finally:
+                for task in (heartbeat_task, read_task):
+                    if task:
+                        task.cancel()
+                self._drop_link()
+
+            if self.running:
+                self.logger.info(f"Reconnecting in {backoff:.1f}s")
+                await asyncio.sleep(backoff)
+                backoff = min(backoff * 2, settings.RECONNECT_MAX_S)
+
+    async def _open(self):
+        self.baud = settings.SERIAL_BAUD
+        self._bad_frames = 0
+        if self.is_socket:
+            # Handle socket literal for testing
+            host_port = self.port.replace("socket://", "")
+            host, port = host_port.split(":")
+            self.reader, self.writer = await asyncio.open_connection(host, int(port))
+        else:
+            self.reader, self.writer = await serial_asyncio.open_serial_connection(
+                url=self.port, baudrate=self.baud
+            )
+        self.logger.info(f"Connected to {self.port}")
 
-    async def send_command(self, command: dict):
+    def _drop_link(self):
+        self.connected = False
+        self._last_fseq = None
+        self._last_sample_ms = None
         if self.writer:
             try:
-                msg = json.dumps(command) + "\n"
-                self.writer.write(msg.encode('utf-8'))
-                await self.writer.drain()
+                self.writer.close()
+            except Exception:
+                pass
+        self.reader = None
+        self.writer = None
+        for fut in self._pending.values():
+            if not fut.done():
+                fut.set_exception(ConnectionError("link dropped"))
+        self._pending.clear()
+
+    def _set_local_baud(self, baud: int):
+        self.baud = baud
+        self._bad_frames = 0
+        if not self.is_socket:
+            self.writer.transport.serial.baudrate = baud
+
+    async def _probe(self) -> bool:
+        return await self._ping(retries=1)
+
+    async def _ping(self, retries: Optional[int] = None) -> bool:
+        # PING doubles as the heartbeat and feeds the clock sync
+        reply = await self._send({"cmd": "PING"}, retries=retries)
+        if reply is None:
+            return False
+        if "t_ms" in reply:
+            self.clock.add(reply["_tx"], reply["t_ms"], reply["_rx"])
+            rtt, offset = self.clock.best
+            self.stats["rtt_ms"] = round(rtt, 2)
+            self.stats["clock_offset_s"] = offset
+        return True
+
+    async def _negotiate(self):
+        # The controller boots at SERIAL_BAUD. If we reconnected without it
+        # resetting it may still sit at a negotiated rate, so look there too.
+        if not await self._probe():
+            for baud in settings.SERIAL_BAUD_RATES:
+                self._set_local_baud(baud)
+                if await self._probe():
+                    return
+            raise ConnectionError("controller did not answer")
+
+        if self.is_socket:
+            return
+
+        for baud in settings.SERIAL_BAUD_RATES:
+            if baud in self._bad_bauds or baud == self.baud:
+                continue
+            acked = await self._send({"cmd": "SET_BAUD", "baud": baud}, retries=1)
+            if acked:
+                self._set_local_baud(baud)
+                if await self._probe():
+                    return
+                self.logger.warning(f"No answer at {baud} baud")
+            # Controller reverts to SERIAL_BAUD on its own
+            self._bad_bauds.add(baud)
+            self._set_local_baud(settings.SERIAL_BAUD)
+            await asyncio.sleep(settings.LINK_FALLBACK_TIMEOUT_S + 0.5)
+            if not await self._probe():
+                raise ConnectionError(f"controller lost after trying {baud} baud")
+
+    async def _heartbeat_loop(self):
+        while True:
+            await asyncio.sleep(settings.HEARTBEAT_INTERVAL_S)
+            if not await self._ping():
+                self.logger.error("Heartbeat not acknowledged, dropping link")
+                self._drop_link()
+                return
+
+    def _on_telemetry(self, data: dict, rx: float):
+        # Stamp the frame with its sample time (wall clock) rather than its
+        # arrival, and account for dropped frames.
+        self.stats["frames"] += 1
+        fseq = data.get("fseq")
+        if fseq is not None:
+            if self._last_fseq is not None and fseq > self._last_fseq:
+                self.stats["frames_dropped"] += fseq - self._last_fseq - 1
+            self._last_fseq = fseq
+
+        t_ms = data.get("t_ms")
+        ts = self.clock.to_wall(t_ms) if t_ms is not None else None
+        if t_ms is not None:
+            if self._last_sample_ms is not None and t_ms > self._last_sample_ms:
+                self.stats["sample_interval_ms"] = t_ms - self._last_sample_ms
+            self._last_sample_ms = t_ms
+        if ts is not None:
+            self.stats["latency_ms"] = round((rx - ts) * 1000.0, 2)
+        data["ts"] = ts if ts is not None else rx
+
+    def get_stats(self) -> dict:
+        return {**self.stats, "connected": self.connected, "baud": self.baud,
+                "port": self.port, "node": self.node}
+
+    async def get_controller_stats(self) -> Optional[dict]:
+        # SRAM usage reported by the firmware (GET_STATS), None if unreachable
+        if not self.connected:
+            return None
+        reply = await self._send({"cmd": "GET_STATS"})
+        return reply.get("mem") if reply else None
+
+    def _frame_error(self):
+        self.stats["crc_errors"] += 1
+        self._bad_frames += 1
+        if self._bad_frames >= settings.LINK_BAD_FRAME_LIMIT and self.baud != settings.SERIAL_BAUD:
+            self.logger.warning(f"CRC errors at {self.baud} baud, falling back")
+            self._bad_bauds.add(self.baud)
+            self._drop_link()
+
+    async def _read_loop(self):
+        while self.running and self.reader:
+            try:
+                line = await self.reader.readline()
+                rx = time.time()
+                if not line:
+                    self.logger.error("Serial EOF")
+                    return
+                decoded = line.decode('utf-8', errors='ignore').strip()
+                if not decoded:
+                    continue
+
+                # The firmware frames everything, so once the link is up a
+                # line without a checksum is a damaged frame
+                payload, crc_ok = unframe(decoded, required=self.connected)
+                if not crc_ok:
+                    self.logger.warning(f"CRC mismatch: {decoded}")
+                    self._frame_error()
+                    continue
+
+                try:
+                    data = json.loads(payload)
+                except json.JSONDecodeError:
+                    self.logger.warning(f"Malformed JSON: {decoded}")
+                    self._frame_error()
+                    continue
+
+                self._bad_frames = 0
+                if self.node is not None and data.get("node", self.node) != self.node:
+                    self.stats["foreign_frames"] += 1
+                    continue
+                if "ack" in data:
+                    fut = self._pending.get(data["ack"])
+                    if fut and not fut.done():
+                        data["_rx"] = rx
+                        fut.set_result(data)
+                elif "uptime" in data or "state" in data:
+                    self._on_telemetry(data, rx)
+                    if self.telemetry_callback:
+                        await self.telemetry_callback(data)
+                elif "error" in data:
+                    zone = f" (zone {data['zone']})" if "zone" in data else ""
+                    self.logger.error(f"FIRMWARE ERROR: {data['error']}{zone}")
+            except asyncio.CancelledError:
+                raise
             except Exception as e:
-                logger.error(f"Write error: {e}")
+                self.logger.error(f"Serial read error: {e}")
+                return
+
+    async def _send(self, command: dict, retries: Optional[int] = None) -> Optional[dict]:
+        # One command in flight at a time so acks and retries stay ordered.
+        # Retries reuse the seq, which the firmware acks without re-executing.
+        # Returns the ack (with host "_tx"/"_rx" times) or None.
+        if retries is None:
+            retries = settings.COMMAND_RETRIES
+        async with self._cmd_lock:
+            self._seq = self._seq % 0xFFFFFFFF + 1
+            seq = self._seq
+            command = {**command, "seq": seq}
+            if self.node is not None:
+                command["node"] = self.node
+            msg = (frame(json.dumps(command, separators=(",", ":"))) + "\n").encode('utf-8')
+
+            for attempt in range(retries):
+                if not self.writer:
+                    return None
+                fut = asyncio.get_running_loop().create_future()
+                self._pending[seq] = fut
+                try:
+                    tx = time.time()
+                    self.writer.write(msg)
+                    await self.writer.drain()
+                    reply = await asyncio.wait_for(fut, settings.COMMAND_TIMEOUT_S)
+                    reply["_tx"] = tx
+                    return reply
+                except asyncio.TimeoutError:
+                    self.logger.warning(f"No ack for seq {seq} (attempt {attempt + 1}/{retries})")
+                except Exception as e:
+                    self.logger.error(f"Write error: {e}")
+                    return None
+                finally:
+                    self._pending.pop(seq, None)
+            return None
+
+    async def send_command(self, command: dict) -> bool:
+        if not self.connected:
+            self.logger.warning(f"Link down, dropping command {command}")
+            return False
+        return await self._send(command) is not None
 
     def set_telemetry_callback(self, callback):
         self.telemetry_callback = callback
-
-serial_link = SerialInterface()
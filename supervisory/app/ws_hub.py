@@ -0,0 +1,139 @@
+import asyncio
+import json
+import time
+from collections import deque
+from itertools import count
+from .config import settings
+
+_MISSING = object()
+
+
+def _encode(data) -> str:
+    # Same encoding as Starlette's send_json
+    return json.dumps(data, separators=(",", ":"), ensure_ascii=False)
+
+
+def diff(prev: dict, cur: dict) -> dict:
+    # Leaves of cur that are new or differ from prev, nested as in cur
+    out = {}
+    for key, value in cur.items():
+        old = prev.get(key, _MISSING)
+        if isinstance(value, dict) and isinstance(old, dict):
+            sub = diff(old, value)
+            if sub:
+                out[key] = sub
+        elif value != old:
+            out[key] = value
+    return out
+
+
+class Frame:
+    __slots__ = ("seq", "t", "full", "delta")
+
+    def __init__(self, seq: int, full: str, delta):
+        self.seq = seq
+        self.t = time.monotonic()
+        self.full = full
+        self.delta = delta  # Changes since frame seq - 1, or None
+
+
+class Client:
+    """One /ws connection: a bounded queue of encoded frames.
+
+    drop_oldest keeps the newest WS_QUEUE_FRAMES frames; latest keeps only the
+    newest frame, so a client that falls behind skips straight to the current
+    state. Delta clients get {"delta": true, ...changed leaves} when they
+    received the previous frame, and the full frame otherwise.
+    """
+
+    POLICIES = ("drop_oldest", "latest")
+
+    def __init__(self, cid: int, name: str, policy: str, delta: bool):
+        self.cid = cid
+        self.name = name
+        self.policy = policy
+        self.delta = delta
+        self._frames = deque(maxlen=1 if policy == "latest" else settings.WS_QUEUE_FRAMES)
+        self._ready = asyncio.Event()
+        self._last_seq = None  # Last frame handed out
+        self._since = time.monotonic()  # Replayed frames count from here
+        self.stats = {
+            "sent": 0,
+            "dropped": 0,  # Overwritten in the queue before being sent
+            "delta_sent": 0,
+            "lag_ms": None,  # Publish -> handed to the socket, last frame
+            "max_lag_ms": 0.0,
+        }
+
+    def offer(self, frame: Frame):
+        if len(self._frames) == self._frames.maxlen:
+            self.stats["dropped"] += 1
+        self._frames.append(frame)
+        self._ready.set()
+
+    async def next(self) -> str:
+        while not self._frames:
+            self._ready.clear()
+            await self._ready.wait()
+        frame = self._frames.popleft()
+
+        lag = round((time.monotonic() - max(frame.t, self._since)) * 1000.0, 2)
+        self.stats["lag_ms"] = lag
+        self.stats["max_lag_ms"] = max(self.stats["max_lag_ms"], lag)
+        self.stats["sent"] += 1
+
+        in_sequence = self._last_seq is not None and frame.seq == self._last_seq + 1
+        self._last_seq = frame.seq
+        if self.delta and in_sequence and frame.delta is not None:
+            self.stats["delta_sent"] += 1
+            return frame.delta
+        return frame.full
+
+    def get_stats(self) -> dict:
+        return dict(self.stats, id=self.cid, client=self.name, policy=self.policy,
+                    delta=self.delta, queued=len(self._frames))
+
+
+class WebSocketHub:
+    """Telemetry fan-out to /ws clients.
+
+    publish() encodes each frame once (and its delta once) and appends the
+    strings to every client's queue without awaiting, so a slow client can
+    neither hold up telemetry handling nor grow memory past its queue.
+    """
+
+    def __init__(self):
+        self.clients = set()
+        self._cids = count(1)
+        self._seq = count(1)
+        self._prev = None
+        self._recent = deque(maxlen=settings.WS_QUEUE_FRAMES)  # Replayed to new clients
+        self.stats = {"frames": 0, "encode_ms": None}
+
+    def publish(self, data: dict):
+        t0 = time.perf_counter()
+        delta = None
+        if self._prev is not None and any(c.delta for c in self.clients):
+            delta = _encode(dict(diff(self._prev, data), delta=True))
+        frame = Frame(next(self._seq), _encode(data), delta)
+        self._prev = data
+        self.stats["frames"] += 1
+        self.stats["encode_ms"] = round((time.perf_counter() - t0) * 1000.0, 3)
+
+        self._recent.append(frame)
+        for client in self.clients:
+            client.offer(frame)
+
+    def subscribe(self, name: str, policy: str = "drop_oldest", delta: bool = False) -> Client:
+        client = Client(next(self._cids), name, policy, delta)
+        for frame in self._recent:
+            client.offer(frame)
+        client.stats["dropped"] = 0  # Backlog that didn't fit isn't a drop
+        self.clients.add(client)
+        return client
+
+    def unsubscribe(self, client: Client):
+        self.clients.discard(client)
+
+    def get_stats(self) -> dict:
+        return dict(self.stats, clients=[c.get_stats() for c in sorted(self.clients, key=lambda c: c.cid)])
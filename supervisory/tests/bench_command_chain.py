@@ -0,0 +1,291 @@
+"""End-to-end command/telemetry benchmark: REST -> supervisor -> serial -> firmware -> telemetry -> /ws.
+
+Starts a controller (the native firmware build or mock_arduino.py) and the
+supervisor, then measures:
+  - POST /api/control/setpoint -> ack latency (p50/p99)
+  - POST -> new setpoint visible in /ws telemetry (p50/p99)
+  - the highest command rate that is fully acked with no telemetry loss
+
+Native firmware (same command parser, framing and UART pacing as the Mega):
+    cd firmware && pio run -e native
+    python tests/bench_command_chain.py --controller host
+
+Use --json for machine-readable output and --max-p99-ms / --min-rate to turn
+it into a regression gate (non-zero exit when exceeded).
+"""
+import argparse
+import asyncio
+import json
+import os
+import re
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+import websockets
+
+SUPERVISORY_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DEFAULT_HOST_BIN = os.path.join(SUPERVISORY_DIR, "..", "firmware", ".pio", "build", "native", "program")
+BENCH_ZONE = 0  # gas
+BENCH_ZONE_KEY = "gas"
+
+
+def free_port() -> int:
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    k = min(len(values) - 1, max(0, round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def http(method, url):
+    req = urllib.request.Request(url, method=method)
+    with urllib.request.urlopen(req, timeout=5) as f:
+        return json.loads(f.read().decode("utf-8"))
+
+
+def stop(proc):
+    # uvicorn waits for open /ws handlers on SIGTERM, so don't wait forever
+    proc.terminate()
+    try:
+        proc.wait(5)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+
+
+def start_controller(args):
+    if args.controller == "host":
+        # A pty goes through pyserial and SET_BAUD negotiation; TCP skips both
+        cmd = [args.host_bin] if args.pty else [args.host_bin, "--tcp", str(free_port())]
+        proc = subprocess.Popen(cmd, stderr=subprocess.PIPE, text=True)
+        # host_main prints "HOST_PTY /dev/pts/N" or "HOST_TCP socket://..." once ready
+        for line in proc.stderr:
+            m = re.search(r"HOST_(?:PTY|TCP) (\S+)", line)
+            if m:
+                return proc, m.group(1)
+        raise RuntimeError("native firmware exited before listening")
+    proc = subprocess.Popen([sys.executable, os.path.join(SUPERVISORY_DIR, "tests", "mock_arduino.py")],
+                            stdout=subprocess.DEVNULL)
+    time.sleep(1.0)
+    return proc, "socket://127.0.0.1:9999"
+
+
+def start_supervisor(serial_port, api_port, db_path, reactors=""):
+    # reactors: a REACTORS list ("name=port@node,...") instead of serial_port
+    env = dict(os.environ, SERIAL_PORT=serial_port, REACTORS=reactors, DATABASE_URL=f"sqlite:///{db_path}")
+    proc = subprocess.Popen([sys.executable, "-m", "uvicorn", "app.main:app", "--port", str(api_port),
+                             "--log-level", "warning"],
+                            cwd=SUPERVISORY_DIR, env=env, stdout=subprocess.DEVNULL)
+    base = f"http://127.0.0.1:{api_port}"
+    deadline = time.time() + 20
+    while time.time() < deadline:
+        try:
+            if all(r["connected"] for r in http("GET", f"{base}/api/reactors")):
+                return proc, base
+        except OSError:
+            pass
+        time.sleep(0.2)
+    stop(proc)
+    raise RuntimeError("supervisor did not connect to every controller")
+
+
+class TelemetryWatch:
+    """Collects /ws telemetry with arrival times and tracks fseq gaps."""
+
+    def __init__(self):
+        self.frames = 0
+        self.gaps = 0
+        self._last_fseq = None
+        self._waiters = []  # (setpoint, future)
+
+    async def run(self, url):
+        async with websockets.connect(url, max_size=None) as ws:
+            async for raw in ws:
+                self.on_message(json.loads(raw), time.perf_counter())
+
+    def on_message(self, msg, now):
+        fseq = msg.get("fseq")
+        if fseq is not None:
+            if self._last_fseq is not None and fseq > self._last_fseq:
+                self.gaps += fseq - self._last_fseq - 1
+            if self._last_fseq is None or fseq > self._last_fseq:
+                self.frames += 1
+            self._last_fseq = fseq
+        sp = msg.get("sp", {}).get(BENCH_ZONE_KEY)
+        for value, fut in list(self._waiters):
+            if sp is not None and abs(sp - value) < 1e-3 and not fut.done():
+                fut.set_result(now)
+
+    def wait_for_setpoint(self, value):
+        fut = asyncio.get_running_loop().create_future()
+        self._waiters.append((value, fut))
+        fut.add_done_callback(lambda _f: self._waiters.remove((value, fut)))
+        return fut
+
+
+async def post_setpoint(base, value):
+    url = f"{base}/api/control/setpoint?zone={BENCH_ZONE}&value={value}"
+    t0 = time.perf_counter()
+    resp = await asyncio.to_thread(http, "POST", url)
+    return t0, time.perf_counter(), bool(resp.get("acked"))
+
+
+async def measure_latency(base, watch, samples, vis_timeout):
+    ack_ms, vis_ms, nacks = [], [], 0
+    for i in range(samples):
+        value = round(20.0 + (i % 500) * 0.1, 1)
+        visible = watch.wait_for_setpoint(value)
+        t0, t_ack, acked = await post_setpoint(base, value)
+        if not acked:
+            nacks += 1
+            visible.cancel()
+            continue
+        ack_ms.append((t_ack - t0) * 1000.0)
+        try:
+            t_vis = await asyncio.wait_for(visible, vis_timeout)
+            vis_ms.append((t_vis - t0) * 1000.0)
+        except asyncio.TimeoutError:
+            nacks += 1
+    return {
+        "samples": samples,
+        "failed": nacks,
+        "ack_p50_ms": percentile(ack_ms, 50),
+        "ack_p99_ms": percentile(ack_ms, 99),
+        "visible_p50_ms": percentile(vis_ms, 50),
+        "visible_p99_ms": percentile(vis_ms, 99),
+    }
+
+
+async def run_rate(base, watch, rate, duration):
+    """Fires setpoint commands at a fixed rate; returns loss figures for that step."""
+    link_before = http("GET", f"{base}/api/link")
+    gaps_before = watch.gaps
+    n = max(1, int(rate * duration))
+    tasks = []
+    start = time.perf_counter()
+    for i in range(n):
+        delay = start + i / rate - time.perf_counter()
+        if delay > 0:
+            await asyncio.sleep(delay)
+        tasks.append(asyncio.create_task(post_setpoint(base, round(30.0 + (i % 500) * 0.1, 1))))
+    results = await asyncio.gather(*tasks, return_exceptions=True)
+    elapsed = max(r[1] for r in results if not isinstance(r, BaseException)) - start if tasks else duration
+    await asyncio.sleep(0.5)  # Let trailing telemetry arrive
+    link_after = http("GET", f"{base}/api/link")
+    acked = sum(1 for r in results if not isinstance(r, BaseException) and r[2])
+    return {
+        "rate": rate,
+        "sent": n,
+        "acked": acked,
+        "achieved_rate": round(acked / elapsed, 1) if elapsed > 0 else None,
+        "frames_dropped": link_after["frames_dropped"] - link_before["frames_dropped"],
+        "crc_errors": link_after["crc_errors"] - link_before["crc_errors"],
+        "ws_gaps": watch.gaps - gaps_before,
+    }
+
+
+def step_ok(step):
+    return (step["acked"] == step["sent"] and step["frames_dropped"] == 0
+            and step["crc_errors"] == 0 and step["ws_gaps"] == 0
+            and step["achieved_rate"] is not None and step["achieved_rate"] >= 0.9 * step["rate"])
+
+
+async def bench(args, base):
+    watch = TelemetryWatch()
+    ws_task = asyncio.create_task(watch.run(base.replace("http://", "ws://") + "/ws"))
+    await asyncio.sleep(1.0)
+
+    latency = await measure_latency(base, watch, args.samples, args.visible_timeout)
+
+    steps, max_rate = [], 0.0
+    for rate in args.rates:
+        step = await run_rate(base, watch, rate, args.step_seconds)
+        steps.append(step)
+        if not step_ok(step):
+            break
+        max_rate = rate
+
+    ws_task.cancel()
+    link = http("GET", f"{base}/api/link")
+    return {
+        "controller": args.controller,
+        "latency": latency,
+        "rate_steps": steps,
+        "max_lossless_rate": max_rate,
+        "telemetry": {"frames": watch.frames, "ws_gaps": watch.gaps},
+        "link": link,
+    }
+
+
+def print_report(r):
+    lat = r["latency"]
+    fmt = lambda v: "-" if v is None else f"{v:.1f}"
+    print(f"Controller: {r['controller']}  baud: {r['link'].get('baud')}")
+    print(f"POST->ack      p50 {fmt(lat['ack_p50_ms'])} ms  p99 {fmt(lat['ack_p99_ms'])} ms")
+    print(f"POST->visible  p50 {fmt(lat['visible_p50_ms'])} ms  p99 {fmt(lat['visible_p99_ms'])} ms"
+          f"  ({lat['failed']}/{lat['samples']} failed)")
+    print("Rate sweep (cmd/s): sent/acked  achieved  dropped  crc  ws_gaps")
+    for s in r["rate_steps"]:
+        print(f"  {s['rate']:6.0f}: {s['sent']}/{s['acked']}  {s['achieved_rate']}  "
+              f"{s['frames_dropped']}  {s['crc_errors']}  {s['ws_gaps']}")
+    print(f"Max lossless command rate: {r['max_lossless_rate']} cmd/s")
+    print(f"Telemetry frames: {r['telemetry']['frames']}  gaps: {r['telemetry']['ws_gaps']}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--controller", choices=("host", "mock"), default="host")
+    ap.add_argument("--host-bin", default=DEFAULT_HOST_BIN, help="native firmware binary")
+    ap.add_argument("--pty", action="store_true", help="connect to the native build over a pty")
+    ap.add_argument("--api-port", type=int, default=0, help="supervisor port (default: free port)")
+    ap.add_argument("--samples", type=int, default=200)
+    ap.add_argument("--visible-timeout", type=float, default=2.0)
+    ap.add_argument("--rates", type=lambda s: [float(x) for x in s.split(",")],
+                    default=[5, 10, 20, 50, 100, 200, 400])
+    ap.add_argument("--step-seconds", type=float, default=3.0)
+    ap.add_argument("--json", action="store_true", help="print results as JSON")
+    ap.add_argument("--max-p99-ms", type=float, help="fail if POST->ack p99 exceeds this")
+    ap.add_argument("--min-rate", type=float, help="fail if max lossless rate is below this")
+    args = ap.parse_args()
+
+    controller, serial_port = start_controller(args)
+    supervisor = None
+    try:
+        with tempfile.TemporaryDirectory() as tmp:
+            supervisor, base = start_supervisor(serial_port, args.api_port or free_port(),
+                                                os.path.join(tmp, "bench.db"))
+            result = asyncio.run(bench(args, base))
+            stop(supervisor)
+            supervisor = None
+    finally:
+        if supervisor:
+            stop(supervisor)
+        stop(controller)
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print_report(result)
+
+    failed = []
+    p99 = result["latency"]["ack_p99_ms"]
+    if args.max_p99_ms is not None and (p99 is None or p99 > args.max_p99_ms):
+        failed.append(f"ack p99 {p99} ms > {args.max_p99_ms} ms")
+    if args.min_rate is not None and result["max_lossless_rate"] < args.min_rate:
+        failed.append(f"max lossless rate {result['max_lossless_rate']} < {args.min_rate} cmd/s")
+    for f in failed:
+        print(f"REGRESSION: {f}", file=sys.stderr)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
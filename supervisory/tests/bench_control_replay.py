@@ -0,0 +1,604 @@
+"""Control-performance regression suite: recorded runs replayed through the firmware.
+
+A case is a recorded run reduced to what drove it: the state, setpoint and
+flow changes the operator made, the starting temperatures, and HostPlant
+coefficients fitted to the run (least squares, then refined by replaying the
+run until the heater outputs and PVs match the log). Runs logged before
+process_log had sp_flow replay without their flow changes. The replay build
+(firmware/host/replay, `pio run -e replay`) runs the real setup()/loop() -
+HeaterController, the PV filters, checkSafety() - against that plant in
+simulated time, a 12 h run taking seconds. Per zone it reports:
+  - IAE: integral of |setpoint - PV| while heating (degC s)
+  - overshoot past each new setpoint (degC), the worst one
+  - settling time into +-SETTLE_BAND_C of each new setpoint, the worst one
+    of the moves that settled, and the number that had not settled when the
+    setpoint moved on (unsettled)
+  - SSR switching count
+and the host CPU time (and TSC cycles on x86) of loop() passes that ran the
+10 Hz control tick, p50/p99, and per zone the p50/p99 of its share of
+HeaterBank::update() in those ticks (its PID, feedforward and decoupling).
+
+    # Cut a run out of a log into tests/replay_cases/<name>.json
+    python tests/bench_control_replay.py extract --db reactor_logs.db --list
+    python tests/bench_control_replay.py extract --db reactor_logs.db --run 3 --name warmup_350
+
+    # Replay every case against its baseline; non-zero exit on a regression
+    python tests/bench_control_replay.py run
+    python tests/bench_control_replay.py run --update-baseline
+
+    # Record a scripted run from the native build through the supervisor
+    python tests/bench_control_replay.py record --name host_profile
+    python tests/bench_control_replay.py record --profile reactor_steps --pid 5,0.05,0
+
+Control metrics are deterministic, so --tol only absorbs compiler and libm
+differences. CPU time depends on the machine: it is only gated with
+--cpu-tol, against a baseline written on the same machine.
+"""
+import argparse
+import glob
+import json
+import os
+import sqlite3
+import subprocess
+import sys
+import tempfile
+import time
+from collections import deque
+from datetime import datetime, timezone
+
+SUPERVISORY_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, SUPERVISORY_DIR)
+from app.config import COUPLED_ZONES, FLOW_ZONES, TC_COLUMNS, ZONE_KEYS, ZONE_PV_TCS
+
+CASES_DIR = os.path.join(SUPERVISORY_DIR, "tests", "replay_cases")
+DEFAULT_REPLAY_BIN = os.path.join(SUPERVISORY_DIR, "..", "firmware", ".pio", "build", "replay", "program")
+
+# process_log columns of each zone's heater node and, for reactors, wall node
+ZONE_TCS = {z: (TC_COLUMNS[tcs[0]], TC_COLUMNS[tcs[1]] if len(tcs) > 1 else None)
+            for z, tcs in ZONE_PV_TCS.items()}
+REACTOR_ZONES = tuple(i for i, z in enumerate(ZONE_KEYS) if ZONE_TCS[z][1])  # What --pid tunes
+HEATING_STATES = (1, 2)  # Warmup, Working
+REPLAYED_STATES = (0, 1, 2)  # Alarm and Fault are the firmware's to reach
+
+# HostPlant defaults, kept where a run doesn't excite a coefficient
+DEFAULT_PLANT = {"gas": [40.0, 0.05, 0.0, 0.0], "vap": [40.0, 0.05, 0.0, 0.0],
+                 "reac1": [30.0, 0.02, 0.1, 0.01], "reac2": [30.0, 0.02, 0.1, 0.01]}
+DEFAULT_COUPLING = 0.015
+DEFAULT_FLOWLOAD = [4e-5, 5e-3]
+
+RUN_GAP_S = 60  # A logging gap this long starts a new run
+FIT_INTERVAL_S = 1.0  # WINDOW_SIZE in HeaterController.h
+TICK_S = 0.1  # LOOP_INTERVAL_MS in config.h
+SETTLE_BAND_C = 2.0
+REFINE_BIN_S = 10.0  # Replay vs recording is compared in means over this
+
+# Lower is better for every metric; a regression exceeds
+# baseline * (1 + tol) + slack
+METRICS = ("iae", "overshoot", "settling_s", "unsettled", "ssr_switches")
+SLACK = {"iae": 1.0, "overshoot": 0.2, "settling_s": 1.0, "unsettled": 0, "ssr_switches": 10}
+
+
+# --- replay program ---
+
+def write_case_text(case, path):
+    # The directive file host/replay/replay_main.cpp reads
+    lines = [f"# {case['source']}", f"ambient {case['ambient']}", f"coupling {case['coupling']}",
+             "flowload {} {}".format(*case["flowload"]), f"baud {case['baud']}"]
+    for i, z in enumerate(ZONE_KEYS):
+        lines.append("plant {} {} {} {} {}".format(i, *case["plant"][z]))
+        lines.append("init {} {} {}".format(i, *case["init"][z]))
+    for ev in sorted(case["events"], key=lambda e: e[0]):
+        lines.append(" ".join(str(v) for v in ev))
+    lines.append(f"end {case['end']}")
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def replay_trace(case, program, step_us=1000, keep=None):
+    """Runs the replay program on a case: (summary, per-tick trace rows)."""
+    with tempfile.TemporaryDirectory() as tmp:
+        txt, csv_path = os.path.join(tmp, "case.txt"), os.path.join(tmp, "trace.csv")
+        write_case_text(case, txt)
+        out = subprocess.run([program, txt, "--trace", csv_path, "--step-us", str(step_us)],
+                             capture_output=True, text=True)
+        if out.returncode != 0:
+            raise RuntimeError(f"replay failed: {out.stderr.strip()}")
+        with open(csv_path) as f:
+            header = f.readline().strip().split(",")
+            trace = [dict(zip(header, map(float, line.split(",")))) for line in f]
+        if keep:
+            os.replace(csv_path, keep)
+    return json.loads(out.stdout.strip().splitlines()[-1]), trace
+
+
+# --- extract ---
+
+def _epoch(ts):
+    # process_log timestamps are naive UTC
+    return datetime.fromisoformat(ts).replace(tzinfo=timezone.utc).timestamp()
+
+
+def _utc(t):
+    return f"{datetime.fromtimestamp(t, timezone.utc):%Y-%m-%d %H:%M:%S} UTC"
+
+
+def list_runs(conn):
+    # (first id, last id, start, end, rows), split at logging gaps
+    runs, start, prev = [], None, None
+    for row_id, ts in conn.execute("SELECT id, timestamp FROM process_log ORDER BY id"):
+        t = _epoch(ts)
+        if start is None or t - prev[1] > RUN_GAP_S:
+            if start is not None:
+                runs.append((start[0], prev[0], start[1], prev[1]))
+            start = (row_id, t)
+        prev = (row_id, t)
+    if start is not None:
+        runs.append((start[0], prev[0], start[1], prev[1]))
+    return runs
+
+
+def load_rows(conn, first_id, last_id):
+    conn.row_factory = sqlite3.Row
+    rows = [dict(r) for r in conn.execute("SELECT * FROM process_log WHERE id BETWEEN ? AND ? ORDER BY id",
+                                          (first_id, last_id))]
+    # Sample time from the controller clock where logged (exact spacing),
+    # otherwise the wall clock
+    t0_ms, t0 = rows[0]["controller_ms"], _epoch(rows[0]["timestamp"])
+    for r in rows:
+        if t0_ms is not None and r["controller_ms"] is not None:
+            r["t"] = (r["controller_ms"] - t0_ms) / 1000.0
+        else:
+            r["t"] = _epoch(r["timestamp"]) - t0
+    return rows
+
+
+def lstsq(xs, ys):
+    # Least squares by the normal equations; None where a column is never
+    # excited (all zero) or the system is singular
+    n = len(xs[0])
+    live = [j for j in range(n) if any(abs(x[j]) > 1e-12 for x in xs)]
+    m = len(live)
+    a = [[sum(x[live[i]] * x[live[j]] for x in xs) for j in range(m)] +
+         [sum(x[live[i]] * y for x, y in zip(xs, ys))] for i in range(m)]
+    for col in range(m):
+        piv = max(range(col, m), key=lambda r: abs(a[r][col]))
+        if abs(a[piv][col]) < 1e-12:
+            return [None] * n
+        a[col], a[piv] = a[piv], a[col]
+        for r in range(m):
+            if r != col:
+                f = a[r][col] / a[col][col]
+                a[r] = [v - f * p for v, p in zip(a[r], a[col])]
+    out = [None] * n
+    for i, j in enumerate(live):
+        out[j] = a[i][m] / a[i][i]
+    return out
+
+
+def _intervals(rows):
+    # Consecutive spans of at least one SSR window, so the mean heater output
+    # over a span is the heating it delivered whatever the sample rate
+    i = 0
+    for j in range(1, len(rows)):
+        dt = rows[j]["t"] - rows[i]["t"]
+        if dt >= FIT_INTERVAL_S - 0.01:
+            if dt <= 5 * FIT_INTERVAL_S:
+                yield rows[i:j + 1], dt
+            i = j
+
+
+def fit_plant(rows, ambient):
+    """HostPlant coefficients by least squares on the temperature change over
+    each interval, regressors averaged over it (heater duty = output / 1000)."""
+    samples = {z: ([], []) for z in ZONE_KEYS}
+    walls = {z: ([], []) for z in ZONE_KEYS if ZONE_TCS[z][1]}
+    for span, dt in _intervals(rows):
+        def mean(col):
+            return sum(r[col] for r in span) / len(span)
+
+        def held(col):
+            # Outputs and setpoints hold from one sample to the next
+            return sum(r[col] for r in span[:-1]) / (len(span) - 1)
+
+        flow = held("sp_flow")
+        for z in ZONE_KEYS:
+            hc, wc = ZONE_TCS[z]
+            th = mean(hc) - ambient
+            x = [held(f"heater_{z}") / 1000.0, -th, 0.0, 0.0, 0.0]
+            if z in COUPLED_ZONES:
+                x[2] = mean(ZONE_TCS[COUPLED_ZONES[z]][0]) - ambient - th
+            if z in FLOW_ZONES:
+                x[3] = -flow * th
+            if z == "vap":
+                x[4] = -flow
+            samples[z][0].append(x)
+            samples[z][1].append((span[-1][hc] - span[0][hc]) / dt)
+            if wc:
+                tw = mean(wc) - ambient
+                walls[z][0].append([th - tw, -tw])
+                walls[z][1].append((span[-1][wc] - span[0][wc]) / dt)
+
+    plant, coupling, flowload = {}, [], list(DEFAULT_FLOWLOAD)
+    for z in ZONE_KEYS:
+        heat, loss, k, per_k, vaporize = lstsq(*samples[z])
+        p = list(DEFAULT_PLANT[z])
+        p[0] = heat if heat is not None else p[0]
+        p[1] = loss if loss is not None else p[1]
+        if z in walls:
+            rate, wall_loss = lstsq(*walls[z])
+            p[2] = rate if rate is not None else p[2]
+            p[3] = wall_loss if wall_loss is not None else p[3]
+        plant[z] = [round(v, 6) for v in p]
+        if k is not None:
+            coupling.append(k)
+        if z == "gas" and per_k is not None:
+            flowload[0] = per_k
+        if z == "vap" and vaporize is not None:
+            flowload[1] = vaporize
+    return (plant, round(sum(coupling) / len(coupling), 6) if coupling else DEFAULT_COUPLING,
+            [round(v, 9) for v in flowload])
+
+
+def extract_events(rows):
+    # Operator actions as replay events: state, setpoint and flow setpoint
+    # changes as logged
+    events, last = [], {}
+    for r in rows:
+        t = round(r["t"], 3)
+        if r["control_state"] != last.get("state") and r["control_state"] in REPLAYED_STATES:
+            events.append([t, "state", r["control_state"]])
+        last["state"] = r["control_state"]
+        for i, z in enumerate(ZONE_KEYS):
+            sp = round(r[f"sp_{z}"], 2)
+            if sp != last.get(z):
+                events.append([t, "sp", i, sp])
+                last[z] = sp
+        flow = round(r["sp_flow"], 1)
+        if flow != last.get("flow"):
+            events.append([t, "flow", flow])
+            last["flow"] = flow
+    return events
+
+
+def _bin_means(points):
+    # (t, value) pairs -> {bin: mean}, REFINE_BIN_S bins
+    sums = {}
+    for t, v in points:
+        acc = sums.setdefault(int(t // REFINE_BIN_S), [0.0, 0])
+        acc[0] += v
+        acc[1] += 1
+    return {k: a[0] / a[1] for k, a in sums.items()}
+
+
+def refine_plant(case, rows, args):
+    """Output-error refinement of the least-squares plant. The firmware's
+    SSR on-time per window is not the output it logs (the PID moves within
+    the window), so the heat and loss of fast zones come out biased from the
+    log alone. This scales each zone's heat and loss and the flow load to
+    make the replayed heater outputs and PVs match the recorded ones, in
+    REFINE_BIN_S means, by coordinate search."""
+    case = json.loads(json.dumps(case))
+    end = min(case["end"], args.refine_minutes * 60)
+    case["end"] = end
+    want = {}
+    for z in ZONE_KEYS:
+        hc, wc = ZONE_TCS[z]
+        want[z] = (_bin_means((r["t"], r[f"heater_{z}"]) for r in rows if r["t"] <= end),
+                   _bin_means((r["t"], (r[hc] + r[wc]) / 2 if wc else r[hc]) for r in rows if r["t"] <= end))
+
+    def error():
+        _summary, trace = replay_trace(case, args.program)
+        err = 0.0
+        for z in ZONE_KEYS:
+            out = _bin_means((r["t_s"], r[f"out_{z}"]) for r in trace)
+            pv = _bin_means((r["t_s"], r[f"pv_{z}"]) for r in trace)
+            # 100 of output (10% duty) weighs as much as 1 degC of PV
+            err += sum(((out.get(k, 0.0) - v) / 100.0) ** 2 for k, v in want[z][0].items())
+            err += sum((pv.get(k, 0.0) - v) ** 2 for k, v in want[z][1].items())
+        return err
+
+    params = [(case["plant"][z], i) for z in ZONE_KEYS for i in (0, 1)] + [(case["flowload"], 0),
+                                                                          (case["flowload"], 1)]
+    best, evals, step = error(), 1, 0.2
+    start = best
+    while step >= 0.01 and evals < args.refine_evals:
+        improved = False
+        for values, i in params:
+            for factor in (1 + step, 1 / (1 + step)):
+                old = values[i]
+                values[i] = old * factor
+                err, evals = error(), evals + 1
+                if err < best:
+                    best, improved = err, True
+                    break
+                values[i] = old
+        if not improved:
+            step /= 2
+    print(f"refined over {end / 60:.0f} min in {evals} replays: error {start:.1f} -> {best:.1f}")
+    return ({z: [round(v, 6) for v in case["plant"][z]] for z in ZONE_KEYS},
+            [round(v, 9) for v in case["flowload"]])
+
+
+def extract(args):
+    conn = sqlite3.connect(f"file:{args.db}?mode=ro", uri=True)
+    runs = list_runs(conn)
+    if args.list or not runs:
+        for i, (first, last, t0, t1) in enumerate(runs):
+            print(f"{i:3}  {_utc(t0)}  {(t1 - t0) / 60:8.1f} min  "
+                  f"{last - first + 1} rows")
+        return 0 if runs else 1
+    first, last, t0, _t1 = runs[args.run]
+    rows = load_rows(conn, first, last)
+
+    ambient = args.ambient
+    if ambient is None:
+        # The feedstock TC sits at ambient until the vaporizer heats it
+        ambient = round(min(r["temp_feed"] for r in rows), 2)
+    plant, coupling, flowload = fit_plant(rows, ambient)
+    first_row = rows[0]
+    init = {z: [first_row[ZONE_TCS[z][0]], first_row[ZONE_TCS[z][1] or ZONE_TCS[z][0]]] for z in ZONE_KEYS}
+    case = {
+        "source": f"{os.path.basename(args.db)} run {args.run} from {_utc(t0)}, rows {first}-{last}",
+        "ambient": ambient, "plant": plant, "coupling": coupling, "flowload": flowload,
+        "init": init, "baud": args.baud, "end": round(rows[-1]["t"], 3), "events": extract_events(rows),
+    }
+    if args.pid:
+        # Tunings aren't logged; the run had them from the start
+        case["events"] = [[0.0, "pid", z, *args.pid] for z in REACTOR_ZONES] + case["events"]
+    if args.refine_minutes > 0:
+        if os.path.exists(args.program):
+            case["plant"], case["flowload"] = refine_plant(case, rows, args)
+        else:
+            print(f"{args.program} not found, keeping the least-squares plant", file=sys.stderr)
+    plant, flowload = case["plant"], case["flowload"]
+    os.makedirs(CASES_DIR, exist_ok=True)
+    path = os.path.join(CASES_DIR, f"{args.name}.json")
+    with open(path, "w") as f:
+        json.dump(case, f, indent=1)
+        f.write("\n")
+    print(f"{path}: {case['end'] / 60:.1f} min, {len(case['events'])} events")
+    for z in ZONE_KEYS:
+        print(f"  {z:6} heat {plant[z][0]:8.3f}  loss {plant[z][1]:.4f}  wall {plant[z][2]:.4f} {plant[z][3]:.4f}")
+    print(f"  coupling {coupling}  flow load {flowload}")
+    return 0
+
+
+# --- run ---
+
+def zone_metrics(trace, z):
+    # trace: rows of the replay CSV as dicts of floats. Overshoot and
+    # settling use the PV averaged over an SSR window; fast zones ripple by
+    # more than the band within one.
+    sp_k, pv_k = f"sp_{z}", f"pv_{z}"
+    iae, moves, prev_sp, prev_t = 0.0, [], None, None
+    window = deque(maxlen=int(FIT_INTERVAL_S / TICK_S))
+    for r in trace:
+        heating = int(r["state"]) in HEATING_STATES and r[sp_k] > 0
+        if prev_t is not None and heating:
+            iae += abs(r[sp_k] - r[pv_k]) * (r["t_s"] - prev_t)
+        prev_t = r["t_s"]
+        window.append(r[pv_k])
+        pv = sum(window) / len(window)
+        sp = r[sp_k] if heating else None
+        if sp is not None and sp != prev_sp:
+            moves.append({"t": r["t_s"], "up": sp > pv, "overshoot": 0.0, "out_at": None})
+        prev_sp = sp
+        if sp is not None and moves:
+            m = moves[-1]
+            m["overshoot"] = max(m["overshoot"], pv - sp if m["up"] else sp - pv)
+            if abs(pv - sp) > SETTLE_BAND_C:
+                m["out_at"] = r["t_s"]
+            m["last"] = r["t_s"]
+
+    # An unsettled move has no settling time, only a count: its length says
+    # how long the setpoint was held, not how the loop did
+    settling, unsettled = None, 0
+    for m in moves:
+        if m["out_at"] is not None and m["out_at"] >= m["last"]:
+            unsettled += 1  # Still outside the band when the setpoint moved on
+        else:
+            settling = max(settling or 0.0, m["out_at"] - m["t"] if m["out_at"] is not None else 0.0)
+    return {"iae": round(iae, 1), "overshoot": round(max((m["overshoot"] for m in moves), default=0.0), 2),
+            "settling_s": None if settling is None else round(settling, 1), "unsettled": unsettled,
+            "moves": len(moves)}
+
+
+def replay(case_path, args):
+    with open(case_path) as f:
+        case = json.load(f)
+    keep = None
+    if args.trace_dir:
+        os.makedirs(args.trace_dir, exist_ok=True)
+        keep = os.path.join(args.trace_dir, os.path.splitext(os.path.basename(case_path))[0] + ".csv")
+    summary, trace = replay_trace(case, args.program, args.step_us, keep)
+
+    zones = {}
+    for z in ZONE_KEYS:
+        zones[z] = zone_metrics(trace, z)
+        zones[z]["ssr_switches"] = summary["ssr_switches"][z]
+    cpu = {k: summary[k] for k in ("tick_ns_p50", "tick_ns_p99", "tick_cycles_p50", "tick_cycles_p99",
+                                   "zone_update_cycles", "zone_update_ns")
+           if k in summary}
+    return {"sim_s": summary["sim_s"], "wall_s": summary["wall_s"], "ticks": summary["ticks"],
+            "zones": zones, "cpu": cpu}
+
+
+def compare(result, baseline, args):
+    failed = []
+    for z, base in baseline["zones"].items():
+        for k in METRICS:
+            got, want = result["zones"][z][k], base[k]
+            if got is None or want is None:
+                continue  # No move settled; "unsettled" gates that
+            if got > want * (1 + args.tol) + SLACK[k]:
+                failed.append(f"{z} {k} {got} > baseline {want}")
+    if args.cpu_tol is not None:
+        key = "tick_cycles_p50" if "tick_cycles_p50" in baseline["cpu"] else "tick_ns_p50"
+        got, want = result["cpu"].get(key), baseline["cpu"][key]
+        if got is not None and got > want * (1 + args.cpu_tol):
+            failed.append(f"{key} {got} > baseline {want}")
+    return failed
+
+
+def print_report(name, r):
+    cpu = r["cpu"]
+    cycles = f", {cpu['tick_cycles_p50']}/{cpu['tick_cycles_p99']} cycles" if "tick_cycles_p50" in cpu else ""
+    print(f"{name}: {r['sim_s'] / 60:.1f} min replayed in {r['wall_s']:.2f} s, control tick p50/p99 "
+          f"{cpu['tick_ns_p50'] / 1000:.1f}/{cpu['tick_ns_p99'] / 1000:.1f} us{cycles}")
+    unit = "cycles" if "zone_update_cycles" in cpu else "ns"
+    update = cpu.get(f"zone_update_{unit}", {})
+    print(f"  zone    moves   IAE (C s)  overshoot (C)  settling (s)  unsettled  SSR switches  "
+          f"update ({unit})")
+    for z, m in r["zones"].items():
+        settling = "-" if m["settling_s"] is None else m["settling_s"]
+        cost = "/".join(map(str, update[z])) if z in update else "-"
+        print(f"  {z:6} {m['moves']:6}  {m['iae']:10}  {m['overshoot']:13}  {settling:>12}  "
+              f"{m['unsettled']:9}  {m['ssr_switches']:12}  {cost:>13}")
+
+
+def run(args):
+    if not os.path.exists(args.program):
+        print(f"{args.program} not found; build it with `pio run -e replay` in firmware/", file=sys.stderr)
+        return 2
+    cases = args.cases or sorted(p for p in glob.glob(os.path.join(CASES_DIR, "*.json"))
+                                 if not p.endswith(".baseline.json"))
+    results, failed = {}, []
+    for path in cases:
+        name = os.path.splitext(os.path.basename(path))[0]
+        r = results[name] = replay(path, args)
+        if not args.json:
+            print_report(name, r)
+        base_path = os.path.splitext(path)[0] + ".baseline.json"
+        if args.update_baseline:
+            with open(base_path, "w") as f:
+                json.dump({"zones": {z: {k: m[k] for k in METRICS} for z, m in r["zones"].items()},
+                           "cpu": r["cpu"]}, f, indent=1)
+                f.write("\n")
+        elif os.path.exists(base_path):
+            with open(base_path) as f:
+                failed += [f"{name}: {msg}" for msg in compare(r, json.load(f), args)]
+        else:
+            print(f"{name}: no baseline, run with --update-baseline", file=sys.stderr)
+    if args.json:
+        print(json.dumps(results, indent=2))
+    for f in failed:
+        print(f"REGRESSION: {f}", file=sys.stderr)
+    return 1 if failed else 0
+
+
+# --- record ---
+
+# (seconds, method, path) driven through the supervisor API
+HOST_PROFILE = (
+    (0, "POST", "/api/control/setpoint?zone=0&value=150"),
+    (0, "POST", "/api/control/setpoint?zone=1&value=120"),
+    (0, "POST", "/api/control/setpoint?zone=2&value=300"),
+    (0, "POST", "/api/control/setpoint?zone=3&value=300"),
+    (0, "POST", "/api/control/state/1"),
+    (150, "POST", "/api/control/flow?value=50"),
+    (240, "POST", "/api/control/state/2"),
+    (300, "POST", "/api/control/setpoint?zone=2&value=340"),
+    (420, "POST", "/api/control/flow?value=100"),
+    (480, "POST", "/api/control/setpoint?zone=0&value=180"),
+    (540, "POST", "/api/control/setpoint?zone=3&value=280"),
+)
+
+# Reactor setpoint steps held long enough to settle, one zone at a time and
+# then both; run with --pid, the stock reactor tunings limit-cycle
+REACTOR_STEPS = (
+    (0, "POST", "/api/control/setpoint?zone=0&value=150"),
+    (0, "POST", "/api/control/setpoint?zone=1&value=120"),
+    (0, "POST", "/api/control/setpoint?zone=2&value=300"),
+    (0, "POST", "/api/control/setpoint?zone=3&value=300"),
+    (0, "POST", "/api/control/state/1"),
+    (300, "POST", "/api/control/state/2"),
+    (600, "POST", "/api/control/setpoint?zone=2&value=320"),
+    (900, "POST", "/api/control/setpoint?zone=3&value=320"),
+    (1200, "POST", "/api/control/setpoint?zone=2&value=300"),
+    (1200, "POST", "/api/control/setpoint?zone=3&value=300"),
+)
+
+# --profile: (events, default --seconds)
+PROFILES = {"host_profile": (HOST_PROFILE, 600.0), "reactor_steps": (REACTOR_STEPS, 1500.0)}
+
+
+def record(args):
+    from bench_command_chain import http, start_controller, start_supervisor, free_port, stop
+
+    args.controller, args.pty = "host", False
+    profile, seconds = PROFILES[args.profile]
+    args.seconds = args.seconds or seconds
+    args.name = args.name or args.profile
+    db = os.path.abspath(args.db or os.path.join(tempfile.mkdtemp(), "recorded.db"))
+    ctrl, port = start_controller(args)
+    try:
+        sup, base = start_supervisor(port, free_port(), db)
+        try:
+            if args.pid:
+                for z in REACTOR_ZONES:
+                    http("POST", base + "/api/control/pid?zone={}&kp={}&ki={}&kd={}".format(z, *args.pid))
+            t0 = time.time()
+            for at, method, path in profile:
+                time.sleep(max(0.0, t0 + at - time.time()))
+                http(method, base + path)
+            time.sleep(max(0.0, t0 + args.seconds - time.time()))
+            http("POST", base + "/api/control/state/0")
+            time.sleep(2.0)
+        finally:
+            stop(sup)
+    finally:
+        stop(ctrl)
+    print(f"recorded {args.seconds} s into {db}")
+    args.db, args.run, args.list = db, -1, False
+    return extract(args)
+
+
+def add_refine_args(ap):
+    ap.add_argument("--program", default=DEFAULT_REPLAY_BIN, help="replay program used to refine the plant")
+    ap.add_argument("--refine-minutes", type=float, default=60.0,
+                    help="refine the plant on the first this many minutes of the run (0: least squares only)")
+    ap.add_argument("--refine-evals", type=int, default=300, help="replay budget for refining")
+    ap.add_argument("--pid", type=lambda s: [float(x) for x in s.split(",")],
+                    help="kp,ki,kd the reactor zones ran with (default: the firmware's)")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    ex = sub.add_parser("extract", help="cut a recorded run into a case")
+    ex.add_argument("--db", default=os.path.join(SUPERVISORY_DIR, "reactor_logs.db"))
+    ex.add_argument("--list", action="store_true", help="list the runs in the log")
+    ex.add_argument("--run", type=int, default=-1, help="run index from --list (default: last)")
+    ex.add_argument("--name", default="recorded")
+    ex.add_argument("--ambient", type=float, help="default: lowest feedstock temperature")
+    ex.add_argument("--baud", type=int, default=1000000, help="UART rate the supervisor ran at")
+    add_refine_args(ex)
+
+    rec = sub.add_parser("record", help="record a scripted profile from the native build, then extract it")
+    rec.add_argument("--host-bin", default=os.path.join(SUPERVISORY_DIR, "..", "firmware", ".pio", "build",
+                                                         "native", "program"))
+    rec.add_argument("--profile", choices=sorted(PROFILES), default="host_profile")
+    rec.add_argument("--seconds", type=float, help="default: the profile's length")
+    rec.add_argument("--db", help="SQLite file to record into (default: temp)")
+    rec.add_argument("--name", help="default: the profile name")
+    rec.add_argument("--ambient", type=float)
+    rec.add_argument("--baud", type=int, default=115200, help="the TCP link skips SET_BAUD")
+    add_refine_args(rec)
+
+    rn = sub.add_parser("run", help="replay cases and compare with their baselines")
+    rn.add_argument("cases", nargs="*", help=f"case files (default: all in {os.path.relpath(CASES_DIR)})")
+    rn.add_argument("--program", default=DEFAULT_REPLAY_BIN)
+    rn.add_argument("--step-us", type=int, default=1000, help="simulated time per loop() pass")
+    rn.add_argument("--tol", type=float, default=0.02, help="relative tolerance on control metrics")
+    rn.add_argument("--cpu-tol", type=float, help="gate control tick CPU p50 at baseline * (1 + this)")
+    rn.add_argument("--update-baseline", action="store_true")
+    rn.add_argument("--trace-dir", help="keep each case's per-tick trace CSV here")
+    rn.add_argument("--json", action="store_true")
+
+    args = ap.parse_args()
+    sys.exit({"extract": extract, "record": record, "run": run}[args.cmd](args))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,251 @@
+"""Flow-step disturbance on the gas preheat and vaporizer loops, before and after flow feedforward.
+
+Holds both zones at setpoint, steps the flow and records how far each
+temperature sags and how long it takes to recover. This runs twice. The first
+run is with feedforward off. The second uses gains fitted from the first
+run's steady-state heater output change, or the gains given with
+--ff-gas/--ff-vap.
+
+Simulation (native firmware build, which models the flow load):
+    python tests/bench_flow_disturbance.py --controller host
+On the rig, against the running supervisor (heaters and MFC live!):
+    python tests/bench_flow_disturbance.py --url http://<pi>:8000 --sp-gas 300 --sp-vap 180 \\
+        --flow-high 1000 --window-s 600 --steady-s 120 --settle-timeout 3600
+
+Fitted gains are printed in the units of FF_*_PER_K in firmware config.h.
+"""
+import argparse
+import asyncio
+import json
+import os
+import sys
+import tempfile
+import time
+import urllib.parse
+
+import websockets
+
+from bench_command_chain import free_port, http, start_controller, start_supervisor, stop, DEFAULT_HOST_BIN, SUPERVISORY_DIR
+
+sys.path.insert(0, SUPERVISORY_DIR)
+from app.config import FLOW_ZONES, ZONE_KEYS, ZONE_PV_TCS
+
+# (zone index, key under heaters/sp, PV telemetry keys, inlet telemetry key
+# or None for ambient, FF_AMBIENT_C)
+ZONES = tuple((ZONE_KEYS.index(key), key, ZONE_PV_TCS[key], inlet) for key, inlet in FLOW_ZONES.items())
+
+
+class Recorder:
+    def __init__(self):
+        self.samples = []  # (t, msg)
+
+    async def run(self, url):
+        async with websockets.connect(url, max_size=None) as ws:
+            async for raw in ws:
+                msg = json.loads(raw)
+                if "sensors" in msg:
+                    self.samples.append((msg.get("ts") or time.time(), msg))
+
+    def since(self, t0):
+        return [(t, m) for t, m in self.samples if t >= t0]
+
+
+def post(url, path, **params):
+    return http("POST", f"{url}{path}?{urllib.parse.urlencode(params)}")
+
+
+SSR_WINDOW_S = 1.0  # WINDOW_SIZE in firmware HeaterController.h
+
+
+def error(msg, key, pv_key):
+    # pv_key may be a tuple of telemetry keys the firmware averages into the PV
+    keys = pv_key if isinstance(pv_key, tuple) else (pv_key,)
+    values = [msg["sensors"].get(k) for k in keys]
+    if None in values:
+        return None
+    return msg["sp"][key] - sum(values) / len(values)
+
+
+def smoothed_errors(samples, key, pv_key):
+    # Setpoint error averaged over one SSR window, so the ripple of the
+    # time-proportional output isn't counted as disturbance
+    out, window = [], []
+    for t, m in samples:
+        e = error(m, key, pv_key)
+        if e is None:
+            continue
+        window.append((t, e))
+        while window[0][0] <= t - SSR_WINDOW_S:
+            window.pop(0)
+        out.append((t, sum(v for _, v in window) / len(window)))
+    return out
+
+
+async def wait_steady(rec, args, label, zones=ZONES):
+    """Waits until all zones have been within tolerance for --steady-s."""
+    deadline = time.time() + args.settle_timeout
+    while time.time() < deadline:
+        await asyncio.sleep(1.0)
+        window = rec.since(time.time() - args.steady_s)
+        if not window or window[-1][0] - window[0][0] < args.steady_s * 0.9:
+            continue
+        errors = [e for _, key, pv, _ in zones
+                  for t, e in smoothed_errors(window, key, pv) if t >= window[0][0] + SSR_WINDOW_S]
+        if errors and all(abs(e) <= args.tolerance for e in errors):
+            return window
+    raise RuntimeError(f"zones did not settle within {args.settle_timeout}s ({label})")
+
+
+def mean_output(window, key):
+    return sum(m["heaters"][key] for _, m in window) / len(window)
+
+
+def step_metrics(samples, t_step, key, pv_key, tolerance):
+    sag, iae, last_out, prev_t = 0.0, 0.0, t_step, t_step
+    for t, e in smoothed_errors(samples, key, pv_key):
+        sag = max(sag, e)
+        iae += abs(e) * (t - prev_t)
+        prev_t = t
+        if abs(e) > tolerance:
+            last_out = t
+    return {"max_sag_c": round(sag, 2), "iae_c_s": round(iae, 1),
+            "recovery_s": round(last_out - t_step, 1)}
+
+
+async def run_step(base, rec, args, label):
+    steady = await wait_steady(rec, args, label)
+    u0 = {key: mean_output(steady, key) for _, key, _, _ in ZONES}
+
+    t_step = time.time()
+    post(base, "/api/control/flow", value=args.flow_high)
+    await asyncio.sleep(args.window_s)
+    samples = rec.since(t_step)
+    tail = samples[int(len(samples) * 0.75):]
+
+    result = {"label": label, "zones": {}}
+    for _, key, pv_key, inlet_key in ZONES:
+        zone = step_metrics(samples, t_step, key, pv_key, args.tolerance)
+        zone["output_before"] = round(u0[key], 1)
+        zone["output_after"] = round(mean_output(tail, key), 1)
+        inlet = tail[-1][1]["sensors"].get(inlet_key) if inlet_key else None
+        zone["rise_c"] = tail[-1][1]["sp"][key] - (inlet if inlet is not None else args.ambient)
+        result["zones"][key] = zone
+
+    post(base, "/api/control/flow", value=args.flow_low)
+    return result
+
+
+def fit_per_k(step, args):
+    # All of the extra output is attributed to the per-degree term, which
+    # reproduces the measured load at this setpoint
+    d_flow = args.flow_high - args.flow_low
+    gains = {}
+    for _, key, _, _ in ZONES:
+        z = step["zones"][key]
+        if z["rise_c"] <= 0:
+            gains[key] = 0.0
+        else:
+            gains[key] = max(0.0, (z["output_after"] - z["output_before"]) / (d_flow * z["rise_c"]))
+    return gains
+
+
+async def bench(args, base):
+    rec = Recorder()
+    rec_task = asyncio.create_task(rec.run(base.replace("http://", "ws://") + "/ws"))
+
+    for zone, _, _, _ in ZONES:
+        post(base, "/api/control/feedforward", zone=zone, base=0, per_k=0)
+    post(base, "/api/control/flow", value=args.flow_low)
+    post(base, "/api/control/setpoint", zone=0, value=args.sp_gas)
+    post(base, "/api/control/setpoint", zone=1, value=args.sp_vap)
+    post(base, "/api/control/state/1")  # WARMUP: heaters and MFC enabled
+
+    try:
+        before = await run_step(base, rec, args, "feedforward off")
+        gains = {"gas": args.ff_gas, "vap": args.ff_vap}
+        fitted = fit_per_k(before, args)
+        for key in gains:
+            if gains[key] is None:
+                gains[key] = fitted[key]
+
+        for zone, key, _, _ in ZONES:
+            post(base, "/api/control/feedforward", zone=zone, base=0, per_k=gains[key])
+        after = await run_step(base, rec, args, "feedforward on")
+        await wait_steady(rec, args, "final")
+    finally:
+        if not args.keep_ff:
+            for zone, _, _, _ in ZONES:
+                post(base, "/api/control/feedforward", zone=zone, base=0, per_k=0)
+        if not args.keep_running:
+            post(base, "/api/control/state/0")
+        rec_task.cancel()
+
+    return {"before": before, "after": after, "ff_per_k": gains, "ff_fitted_per_k": fitted,
+            "flow_sccm": [args.flow_low, args.flow_high]}
+
+
+def print_report(r):
+    print(f"Flow step {r['flow_sccm'][0]} -> {r['flow_sccm'][1]} sccm")
+    print("zone  run               max sag (C)  IAE (C*s)  recovery (s)")
+    for _, key, _, _ in ZONES:
+        for run in (r["before"], r["after"]):
+            z = run["zones"][key]
+            print(f"{key:5} {run['label']:17} {z['max_sag_c']:11}  {z['iae_c_s']:9}  {z['recovery_s']:12}")
+    print("Feedforward used (FF_*_PER_K): " + ", ".join(f"{k}={v:.4g}" for k, v in r["ff_per_k"].items()))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--url", help="existing supervisor (rig); otherwise start one")
+    ap.add_argument("--controller", choices=("host", "mock"), default="host")
+    ap.add_argument("--host-bin", default=DEFAULT_HOST_BIN, help="native firmware binary")
+    ap.add_argument("--pty", action="store_true", help="connect to the native build over a pty")
+    ap.add_argument("--sp-gas", type=float, default=300.0)
+    ap.add_argument("--sp-vap", type=float, default=180.0)
+    ap.add_argument("--flow-low", type=float, default=0.0)
+    ap.add_argument("--flow-high", type=float, default=1000.0)
+    ap.add_argument("--ambient", type=float, default=25.0, help="FF_AMBIENT_C in firmware config.h")
+    ap.add_argument("--tolerance", type=float, default=3.0, help="settled band, degrees C")
+    ap.add_argument("--steady-s", type=float, default=5.0)
+    ap.add_argument("--window-s", type=float, default=30.0, help="observation time after the step")
+    ap.add_argument("--settle-timeout", type=float, default=300.0)
+    ap.add_argument("--ff-gas", type=float, help="per_k gain instead of the fitted one")
+    ap.add_argument("--ff-vap", type=float, help="per_k gain instead of the fitted one")
+    ap.add_argument("--keep-ff", action="store_true", help="leave the gains set afterwards")
+    ap.add_argument("--keep-running", action="store_true", help="don't return to STANDBY afterwards")
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-sag-c", type=float, help="fail if a zone sags more than this with feedforward")
+    args = ap.parse_args()
+
+    controller = supervisor = None
+    try:
+        if args.url:
+            base = args.url.rstrip("/")
+            result = asyncio.run(bench(args, base))
+        else:
+            controller, serial_port = start_controller(args)
+            with tempfile.TemporaryDirectory() as tmp:
+                supervisor, base = start_supervisor(serial_port, free_port(), os.path.join(tmp, "bench.db"))
+                result = asyncio.run(bench(args, base))
+                stop(supervisor)
+                supervisor = None
+    finally:
+        if supervisor:
+            stop(supervisor)
+        if controller:
+            stop(controller)
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print_report(result)
+
+    if args.max_sag_c is not None:
+        worst = max(z["max_sag_c"] for z in result["after"]["zones"].values())
+        if worst > args.max_sag_c:
+            print(f"REGRESSION: sag {worst} C > {args.max_sag_c} C", file=sys.stderr)
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+"""/api/history query time on a long run: rollups vs scanning process_log.
+
+Logs --hours of synthetic telemetry at --rate Hz into a temporary SQLite log
+through the log writer's batch path, so the rollups are built incrementally
+as in the supervisor. It then times load_history() for several ranges
+against reading the same range straight from process_log. It also checks
+that each rollup's min/max/avg agrees with the raw rows.
+
+    python tests/bench_history.py --hours 12 --rate 10 --max-ms 100
+"""
+import argparse
+import json
+import math
+import os
+import sys
+import tempfile
+import time
+
+SUPERVISORY_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, SUPERVISORY_DIR)
+
+from bench_log_writer import frame
+
+RANGES = (("5 min", 300), ("1 h", 3600), ("12 h", 43200), ("full run", None))
+# What static/index.html plots
+CHART_SERIES = ("temp_gas", "temp_vap", "temp_r_i1", "temp_r_e1", "pressure_feed", "h2_ppm")
+
+
+def populate(args, t_end):
+    from app.crud import log_fields
+    from app.log_writer import LogWriter
+
+    log_writer = LogWriter()
+    n = int(args.hours * 3600 * args.rate)
+    t0 = t_end - n / args.rate
+    batch, t_start = [], time.perf_counter()
+    for i in range(n):
+        data = frame(i)
+        data["ts"] = t0 + i / args.rate
+        # A slow swing and a one-sample spike per hour for the decimation to keep
+        data["sensors"]["t_r_i1"] = 400.0 + 20.0 * math.sin(i / args.rate / 600.0)
+        if i % int(3600 * args.rate) == 1800:
+            data["sensors"]["t_r_i1"] += 50.0
+        batch.append((0.0, log_fields(data, data["uptime"], data["state"])))
+        if len(batch) == args.batch:
+            log_writer._write(batch)
+            batch = []
+    if batch:
+        log_writer._write(batch)
+    return n, time.perf_counter() - t_start
+
+
+def raw_range(t_from, t_to):
+    from datetime import datetime, timezone
+    from sqlalchemy import select
+    from app.database import engine, ProcessLog
+
+    since = datetime.fromtimestamp(t_from, timezone.utc).replace(tzinfo=None)
+    until = datetime.fromtimestamp(t_to, timezone.utc).replace(tzinfo=None)
+    with engine.connect() as conn:
+        return conn.execute(select(ProcessLog).where(ProcessLog.timestamp >= since,
+                                                     ProcessLog.timestamp < until)).all()
+
+
+def check_rollups():
+    # Every rollup table must agree with an aggregate over the raw rows
+    from sqlalchemy import text
+    from app.database import engine, ROLLUP_TABLES
+
+    bad = []
+    with engine.connect() as conn:
+        raw = conn.execute(text("SELECT count(*), min(temp_r_i1), max(temp_r_i1), avg(temp_r_i1) "
+                                "FROM process_log")).one()
+        for width, table in ROLLUP_TABLES.items():
+            got = conn.execute(text(f"SELECT sum(n), min(temp_r_i1_min), max(temp_r_i1_max), "
+                                    f"sum(temp_r_i1_avg * n) / sum(n) FROM {table.name}")).one()
+            if got[0] != raw[0] or any(abs(a - b) > 1e-6 for a, b in zip(got[1:], raw[1:])):
+                bad.append({"width_s": width, "raw": list(raw), "rollup": list(got)})
+    return bad
+
+
+def bench(args):
+    from app.database import init_db
+    from app.history import load_history
+
+    init_db()
+    t_end = time.time()
+    rows, fill_s = populate(args, t_end)
+
+    queries = []
+    for label, span in RANGES:
+        t_from = None if span is None else t_end - span
+        t0 = time.perf_counter()
+        h = load_history(t_from, t_end, args.points, CHART_SERIES)
+        history_ms = (time.perf_counter() - t0) * 1000.0
+        t0 = time.perf_counter()
+        raw = raw_range(h["from"], t_end)
+        raw_ms = (time.perf_counter() - t0) * 1000.0
+        spike = max((p["temp_r_i1_max"] for p in h["points"]), default=None)
+        queries.append({"range": label, "points": len(h["points"]), "resolution_s": h["resolution_s"],
+                        "history_ms": round(history_ms, 1), "raw_rows": len(raw),
+                        "raw_ms": round(raw_ms, 1), "max_t_r_i1": spike})
+    return {"rows": rows, "fill_rows_per_s": round(rows / fill_s), "queries": queries,
+            "rollup_mismatches": check_rollups()}
+
+
+def print_report(r):
+    print(f"Logged {r['rows']} rows ({r['fill_rows_per_s']} rows/s including rollups)")
+    print("range      points  resolution (s)  history (ms)  raw rows  raw scan (ms)  max t_r_i1")
+    for q in r["queries"]:
+        print(f"{q['range']:10} {q['points']:6}  {q['resolution_s']:14}  {q['history_ms']:12}  "
+              f"{q['raw_rows']:8}  {q['raw_ms']:13}  {q['max_t_r_i1']}")
+    print("Rollups match process_log" if not r["rollup_mismatches"] else f"MISMATCH: {r['rollup_mismatches']}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--hours", type=float, default=12.0)
+    ap.add_argument("--rate", type=float, default=1.0, help="telemetry rate, Hz")
+    ap.add_argument("--batch", type=int, default=50, help="rows per write (LOG_BATCH_ROWS)")
+    ap.add_argument("--points", type=int, default=1000)
+    ap.add_argument("--db-dir", help="directory for the SQLite file (default: temp dir)")
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-ms", type=float, help="fail if a history query takes longer than this")
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory(dir=args.db_dir) as tmp:
+        os.environ["DATABASE_URL"] = f"sqlite:///{os.path.join(tmp, 'bench.db')}"
+        result = bench(args)
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print_report(result)
+
+    failed = bool(result["rollup_mismatches"])
+    if args.max_ms is not None:
+        worst = max(q["history_ms"] for q in result["queries"])
+        if worst > args.max_ms:
+            print(f"REGRESSION: history query {worst} ms > {args.max_ms} ms", file=sys.stderr)
+            failed = True
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
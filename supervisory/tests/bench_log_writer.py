@@ -0,0 +1,119 @@
+"""Telemetry logging cost on the event loop: per-frame commit vs the batched log writer.
+
+Feeds synthetic telemetry frames at a fixed rate into a temporary SQLite log,
+first through crud.create_log (one session and commit per frame, as the
+supervisor used to do on the event loop), then through log_writer.submit. For
+each it reports how long the caller was blocked per frame (p50/p99/max). For
+the writer it also reports the batch write latency and queue depth, plus any
+dropped rows.
+
+    python tests/bench_log_writer.py --rates 1,10,100 --seconds 10
+
+The SQLite file lives in --db-dir (default: a temp dir). Point it at the Pi's
+SD card to measure the storage the supervisor actually logs to.
+"""
+import argparse
+import json
+import os
+import random
+import sys
+import tempfile
+import time
+
+SUPERVISORY_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, SUPERVISORY_DIR)
+
+from bench_command_chain import percentile
+
+
+def frame(i):
+    return {
+        "state": 2, "uptime": i * 0.1, "t_ms": i * 100, "fseq": i, "ts": time.time(),
+        "sensors": {k: 400.0 + random.random() for k in
+                    ("t_gas", "t_feed", "t_vap", "t_r_i1", "t_r_i2", "t_r_e1", "t_r_e2")}
+                   | {"p_feed": 1.2, "p_reac": 1.1, "flow": 500.0, "h2": 12.0},
+        "heaters": {"gas": 40.0, "vap": 35.0, "reac1": 60.0, "reac2": 55.0},
+        "sp": {"gas": 300.0, "vap": 180.0, "reac1": 400.0, "reac2": 400.0},
+    }
+
+
+def feed(write, rate, seconds):
+    # Returns the time write() blocked for each frame, in ms
+    blocked, n = [], int(rate * seconds)
+    start = time.perf_counter()
+    for i in range(n):
+        delay = start + i / rate - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+        t0 = time.perf_counter()
+        write(frame(i))
+        blocked.append((time.perf_counter() - t0) * 1000.0)
+    return {"frames": n, "blocked_p50_ms": round(percentile(blocked, 50), 3),
+            "blocked_p99_ms": round(percentile(blocked, 99), 3), "blocked_max_ms": round(max(blocked), 3)}
+
+
+def bench(args):
+    # DATABASE_URL is read at import, so the app modules load after it is set
+    from app.database import SessionLocal, init_db
+    from app.crud import create_log
+    from app.log_writer import LogWriter
+
+    init_db()
+    log_writer = LogWriter()
+    results = []
+    for rate in args.rates:
+        def sync_write(data):
+            with SessionLocal() as db:
+                create_log(db, data, data["uptime"], data["state"])
+        results.append(dict(feed(sync_write, rate, args.seconds), path="per-frame commit", rate=rate))
+
+        log_writer.start()
+        before = dict(log_writer.stats)
+        step = feed(lambda d: log_writer.submit(d, d["uptime"], d["state"]), rate, args.seconds)
+        log_writer.stop()
+        stats = log_writer.get_stats()
+        step.update(path="log writer", rate=rate,
+                    rows_written=stats["rows_written"] - before["rows_written"],
+                    rows_dropped=stats["rows_dropped"] - before["rows_dropped"],
+                    write_p99_ms=stats["write_p99_ms"], queue_max=stats["queue_max"])
+        results.append(step)
+    return results
+
+
+def print_report(results):
+    print("path              rate (Hz)  blocked p50/p99/max (ms)   written  dropped  write p99 (ms)  queue max")
+    for r in results:
+        blocked = f"{r['blocked_p50_ms']} / {r['blocked_p99_ms']} / {r['blocked_max_ms']}"
+        print(f"{r['path']:17} {r['rate']:9}  {blocked:25}  {r.get('rows_written', r['frames']):7}  "
+              f"{r.get('rows_dropped', '-'):>7}  {r.get('write_p99_ms', '-'):>14}  {r.get('queue_max', '-'):>9}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--rates", type=lambda s: [float(x) for x in s.split(",")], default=[1, 10, 100])
+    ap.add_argument("--seconds", type=float, default=10.0)
+    ap.add_argument("--db-dir", help="directory for the SQLite file (default: temp dir)")
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-p99-ms", type=float, help="fail if the writer blocks the caller longer than this")
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory(dir=args.db_dir) as tmp:
+        os.environ["DATABASE_URL"] = f"sqlite:///{os.path.join(tmp, 'bench.db')}"
+        results = bench(args)
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print_report(results)
+
+    if args.max_p99_ms is not None:
+        worst = max(r["blocked_p99_ms"] for r in results if r["path"] == "log writer")
+        dropped = sum(r["rows_dropped"] for r in results if r["path"] == "log writer")
+        if worst > args.max_p99_ms or dropped:
+            print(f"REGRESSION: writer blocked p99 {worst} ms > {args.max_p99_ms} ms"
+                  f" or {dropped} rows dropped", file=sys.stderr)
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,254 @@
+"""Multi-reactor supervision: N simulated controllers behind one supervisor.
+
+Starts N native firmware builds on local TCP sockets, each answering to its
+own node ID (--node), and one supervisor with REACTORS listing them all.
+Checks that the reactors stay apart:
+  - /ws/{reactor} only carries frames from that reactor's node
+  - a setpoint sent to one reactor shows up in its telemetry and its log
+    table, and nowhere else
+Before that it commands every reactor at --rate Hz at once for --seconds and
+reports, per N: POST -> ack p50/p99 over all reactors, telemetry frames lost
+between controller and /ws, and the supervisor's CPU load, also per
+telemetry frame (command handling included). The controllers and the
+client share the machine with the supervisor, so run it on the Pi's core
+count or more.
+
+    cd firmware && pio run -e native
+    python tests/bench_multi_reactor.py --reactors 1,4,8 --max-p99-ms 50
+
+A failed isolation check always exits non-zero; --max-p99-ms and
+--max-lost add latency and frame loss gates.
+"""
+import argparse
+import asyncio
+import json
+import os
+import sqlite3
+import subprocess
+import sys
+import tempfile
+import time
+
+import websockets
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from bench_command_chain import free_port, http, percentile, start_supervisor, stop, DEFAULT_HOST_BIN
+
+
+def start_controllers(host_bin, n):
+    # Returns the processes and the REACTORS list for them, r1..rN at nodes 1..N
+    procs, spec = [], []
+    try:
+        for node in range(1, n + 1):
+            port = free_port()
+            proc = subprocess.Popen([host_bin, "--tcp", str(port), "--node", str(node)],
+                                    stderr=subprocess.PIPE, text=True)
+            procs.append(proc)
+            if not any("HOST_TCP" in line for line in proc.stderr):
+                raise RuntimeError("native firmware exited before listening")
+            spec.append(f"r{node}=socket://127.0.0.1:{port}@{node}")
+    except BaseException:
+        for proc in procs:
+            stop(proc)
+        raise
+    return procs, ",".join(spec)
+
+
+def cpu_s(pid):
+    # utime + stime of a process, from /proc
+    with open(f"/proc/{pid}/stat") as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+class Channel:
+    """One reactor's /ws stream: frames, fseq gaps, frames from other nodes."""
+
+    def __init__(self, node):
+        self.node = node
+        self.frames = 0
+        self.gaps = 0
+        self.foreign = 0
+        self.sp = {}
+        self._last_fseq = None
+
+    async def run(self, url):
+        async with websockets.connect(url, max_size=None) as ws:
+            async for raw in ws:
+                self.on_message(json.loads(raw))
+
+    def on_message(self, msg):
+        if msg.get("node") != self.node:
+            self.foreign += 1
+            return
+        self.frames += 1
+        fseq = msg.get("fseq")
+        if fseq is not None:
+            if self._last_fseq is not None and fseq > self._last_fseq:
+                self.gaps += fseq - self._last_fseq - 1
+            self._last_fseq = fseq
+        self.sp = msg.get("sp", {})
+
+
+async def post(url):
+    t0 = time.perf_counter()
+    resp = await asyncio.to_thread(http, "POST", url)
+    return (time.perf_counter() - t0) * 1000.0, bool(resp.get("acked"))
+
+
+async def load(base, names, rate, seconds):
+    # Setpoint commands to every reactor at `rate` Hz each, all at once
+    async def one(name):
+        results, start = [], time.perf_counter()
+        for i in range(max(1, int(rate * seconds))):
+            await asyncio.sleep(max(0.0, start + i / rate - time.perf_counter()))
+            value = round(100.0 + (i % 500) * 0.1, 1)
+            results.append(asyncio.create_task(
+                post(f"{base}/api/reactors/{name}/control/setpoint?zone=1&value={value}")))
+        return await asyncio.gather(*results)
+
+    return [r for per in await asyncio.gather(*(one(n) for n in names)) for r in per]
+
+
+def isolation_value(i):
+    return 50.0 + i  # Gas setpoint given to reactor i, unique per reactor
+
+
+async def check_isolation(base, names, channels):
+    failures = []
+    for i, name in enumerate(names):
+        _, acked = await post(f"{base}/api/reactors/{name}/control/setpoint?zone=0&value={isolation_value(i)}")
+        if not acked:
+            failures.append(f"{name}: setpoint not acked")
+    await asyncio.sleep(1.0)  # Several telemetry frames per reactor
+
+    for i, name in enumerate(names):
+        ch = channels[name]
+        if ch.foreign:
+            failures.append(f"{name}: {ch.foreign} frames from another node on /ws/{name}")
+        if ch.sp.get("gas") != isolation_value(i):
+            failures.append(f"{name}: gas setpoint {ch.sp.get('gas')} in telemetry, sent {isolation_value(i)}")
+        live = http("GET", f"{base}/api/reactors/{name}/live")
+        if any(f.get("node") != ch.node for f in live):
+            failures.append(f"{name}: /live holds frames from another node")
+    default = http("GET", f"{base}/api/live")
+    if default and default[-1].get("node") != channels[names[0]].node:
+        failures.append("/api/live is not the first reactor's")
+    return failures
+
+
+def check_log_tables(db_path, reactors):
+    # The last logged gas setpoint of each reactor's table is the one it was sent
+    failures = []
+    with sqlite3.connect(db_path) as conn:
+        for i, r in enumerate(reactors):
+            row = conn.execute(f"SELECT sp_gas, count(*) FROM {r['log_table']} "
+                               f"WHERE id = (SELECT max(id) FROM {r['log_table']})").fetchone()
+            if row[1] == 0 or row[0] != isolation_value(i):
+                failures.append(f"{r['name']}: last sp_gas in {r['log_table']} is {row[0]}, "
+                                f"sent {isolation_value(i)}")
+    return failures
+
+
+async def bench_n(base, sup_pid, reactors, args):
+    names = [r["name"] for r in reactors]
+    channels = {r["name"]: Channel(r["node"]) for r in reactors}
+    ws_base = base.replace("http://", "ws://")
+    tasks = [asyncio.create_task(channels[n].run(f"{ws_base}/ws/{n}")) for n in names]
+    await asyncio.sleep(1.0)
+
+    links_before = {n: http("GET", f"{base}/api/reactors/{n}/link") for n in names}
+    frames_before = sum(ch.frames for ch in channels.values())
+    cpu0, t0 = cpu_s(sup_pid), time.perf_counter()
+    results = await load(base, names, args.rate, args.seconds)
+    await asyncio.sleep(0.5)  # Trailing telemetry
+    cpu1, t1 = cpu_s(sup_pid), time.perf_counter()
+    frames = sum(ch.frames for ch in channels.values()) - frames_before
+
+    lost = sum(ch.gaps for ch in channels.values())
+    for n in names:
+        link = http("GET", f"{base}/api/reactors/{n}/link")
+        lost += link["frames_dropped"] - links_before[n]["frames_dropped"]
+
+    failures = await check_isolation(base, names, channels)
+    for t in tasks:
+        t.cancel()
+
+    ack_ms = [ms for ms, acked in results if acked]
+    return {
+        "reactors": len(names),
+        "sent": len(results),
+        "acked": len(ack_ms),
+        "ack_p50_ms": round(percentile(ack_ms, 50), 2) if ack_ms else None,
+        "ack_p99_ms": round(percentile(ack_ms, 99), 2) if ack_ms else None,
+        "frames": frames,
+        "frames_lost": lost,
+        "cpu_pct": round((cpu1 - cpu0) / (t1 - t0) * 100.0, 1),
+        "cpu_ms_per_frame": round((cpu1 - cpu0) * 1000.0 / frames, 3) if frames else None,
+        "failures": failures,
+    }
+
+
+def run(n, args):
+    controllers, spec = start_controllers(args.host_bin, n)
+    supervisor = None
+    try:
+        with tempfile.TemporaryDirectory() as tmp:
+            db = os.path.join(tmp, "bench.db")
+            supervisor, base = start_supervisor("", free_port(), db, reactors=spec)
+            reactors = http("GET", f"{base}/api/reactors")
+            result = asyncio.run(bench_n(base, supervisor.pid, reactors, args))
+            stop(supervisor)  # Flushes the log writers
+            supervisor = None
+            result["failures"] += check_log_tables(db, reactors)
+    finally:
+        if supervisor:
+            stop(supervisor)
+        for proc in controllers:
+            stop(proc)
+    return result
+
+
+def print_report(results, args):
+    print(f"{args.rate} setpoint cmd/s per reactor for {args.seconds} s")
+    print("reactors  sent/acked  ack p50 (ms)  ack p99 (ms)  frames  lost  CPU %  CPU/frame (ms)  isolation")
+    for r in results:
+        print(f"{r['reactors']:8}  {r['sent']:5}/{r['acked']:<5}  {str(r['ack_p50_ms']):>12}  "
+              f"{str(r['ack_p99_ms']):>12}  {r['frames']:6}  {r['frames_lost']:4}  {r['cpu_pct']:5}  "
+              f"{str(r['cpu_ms_per_frame']):>14}  {'ok' if not r['failures'] else 'FAILED'}")
+        for f in r["failures"]:
+            print(f"    {f}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--reactors", type=lambda s: [int(x) for x in s.split(",")], default=[1, 4, 8])
+    ap.add_argument("--host-bin", default=DEFAULT_HOST_BIN, help="native firmware binary")
+    ap.add_argument("--rate", type=float, default=10.0, help="setpoint commands per s per reactor")
+    ap.add_argument("--seconds", type=float, default=10.0)
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-p99-ms", type=float, help="fail if POST->ack p99 exceeds this")
+    ap.add_argument("--max-lost", type=int, help="fail if more telemetry frames are lost")
+    args = ap.parse_args()
+
+    results = [run(n, args) for n in args.reactors]
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print_report(results, args)
+
+    failed = [f"{r['reactors']} reactors: {f}" for r in results for f in r["failures"]]
+    for r in results:
+        if r["acked"] < r["sent"]:
+            failed.append(f"{r['reactors']} reactors: {r['sent'] - r['acked']} commands not acked")
+        if args.max_p99_ms is not None and (r["ack_p99_ms"] is None or r["ack_p99_ms"] > args.max_p99_ms):
+            failed.append(f"{r['reactors']} reactors: ack p99 {r['ack_p99_ms']} ms > {args.max_p99_ms} ms")
+        if args.max_lost is not None and r["frames_lost"] > args.max_lost:
+            failed.append(f"{r['reactors']} reactors: {r['frames_lost']} frames lost > {args.max_lost}")
+    for f in failed:
+        print(f"REGRESSION: {f}", file=sys.stderr)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
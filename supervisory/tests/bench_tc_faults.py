@@ -0,0 +1,188 @@
+"""Thermocouple fault handling in simulation: nuisance trips and failover.
+
+Runs the replay build (firmware/host/replay) at steady state on the
+host_profile plant, with HostPlant injecting MAX31855 faults, and reports:
+  - nuisance trips to STATE_FAULT per hour with random glitch bursts on every
+    channel at --rates (chance per read of a burst starting, bursts up to
+    --burst reads): the chip flagging a fault, an SPI read of NaN, an SPI
+    read with a wrong value. The controller is re-armed after each trip.
+  - persistent faults that must escalate, and how long that took: an open
+    gas TC (critical, no backup), both reactor zone 1 TCs
+  - persistent faults that must fail over instead: an open reactor zone 1
+    internal TC, at each reac1 setpoint in --failover-sps, whose zone then
+    has to stay under control on the external TC alone: its worst deviation
+    from setpoint after the fault within --max-failover-ratio times that of
+    the same run without the fault (the wall TC lags, so the zone is derated
+    to TC_FAILOVER_DUTY_RATIO times its duty before the fault), and the heater
+    never more than --limit-margin (TC_BACKUP_LIMIT_MARGIN_C) hotter than the
+    wall, or it could pass its maxTempC before the wall TC shows it
+
+    cd firmware && pio run -e replay
+    python tests/bench_tc_faults.py --rates 0.0001,0.001,0.01 --hours 2 --max-trips-per-h 0
+
+To compare with other firmware, build the replay env from that revision's
+firmware/src and pass it as --program. A failed persistent-fault check always
+exits non-zero; --max-trips-per-h gates the glitch runs.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from bench_control_replay import CASES_DIR, DEFAULT_REPLAY_BIN, write_case_text
+from app.config import ZONE_KEYS
+
+# Steady state the runs start in, below every safety limit
+SETPOINTS = {"gas": 250.0, "vap": 150.0, "reac1": 450.0, "reac2": 450.0}
+# TcChannel numbers (firmware/include/ZoneConfig.h) and MAX31855 fault bits
+TC_GAS_INTERNAL, TC_REACTOR_INT_1, TC_REACTOR_EXT_1 = 0, 3, 5
+FAULT_OPEN = 0x01
+FAULT_AT_S = 1200.0  # Once the duty average the failover cap uses has settled
+STATE_FAULT = 4
+
+
+def steady_case(seconds, faults=(), setpoints=SETPOINTS):
+    with open(os.path.join(CASES_DIR, "host_profile.json")) as f:
+        case = json.load(f)
+    case["source"] = "steady state on the host_profile plant"
+    case["init"] = {z: [sp, sp] for z, sp in setpoints.items()}
+    case["events"] = [[0, "state", 2]] + [[0, "sp", i, setpoints[z]] for i, z in enumerate(ZONE_KEYS)]
+    case["events"] += [[FAULT_AT_S, "tcfault", ch, bits] for ch, bits in faults]
+    case["end"] = seconds
+    return case
+
+
+def replay(case, program, extra=(), args=(), trace=False):
+    """Summary of a replay, and its trace rows if asked for."""
+    with tempfile.TemporaryDirectory() as tmp:
+        txt, csv_path = os.path.join(tmp, "case.txt"), os.path.join(tmp, "trace.csv")
+        write_case_text(case, txt)
+        with open(txt, "a") as f:
+            f.writelines(line + "\n" for line in extra)
+        cmd = [program, txt, *args] + (["--trace", csv_path] if trace else [])
+        out = subprocess.run(cmd, capture_output=True, text=True)
+        if out.returncode != 0:
+            raise RuntimeError(f"replay failed: {out.stderr.strip()}")
+        rows = []
+        if trace:
+            with open(csv_path) as f:
+                header = f.readline().strip().split(",")
+                rows = [dict(zip(header, map(float, line.split(",")))) for line in f]
+    return json.loads(out.stdout.strip().splitlines()[-1]), rows
+
+
+def glitch_run(rate, args):
+    summary, _ = replay(steady_case(args.hours * 3600.0), args.program,
+                        extra=[f"seed {args.seed}", f"tcglitch {rate} {args.burst}"], args=["--rearm"])
+    return {
+        "rate": rate,
+        "trips": summary["trips"],
+        "trips_per_h": round(summary["trips"] / args.hours, 2),
+        "faulted_ticks": sum(summary["tc_faulted_ticks"].values()),
+    }
+
+
+def trip_after_s(rows):
+    # Time from the fault to STATE_FAULT, None if it never got there
+    for row in rows:
+        if row["t_s"] >= FAULT_AT_S and row["state"] == STATE_FAULT:
+            return round(row["t_s"] - FAULT_AT_S, 3)
+    return None
+
+
+def persistent_runs(args):
+    seconds = FAULT_AT_S + args.fault_seconds
+    results = []
+
+    for name, faults in (("gas TC open", [(TC_GAS_INTERNAL, FAULT_OPEN)]),
+                         ("reac1 int+ext TCs open", [(TC_REACTOR_INT_1, FAULT_OPEN),
+                                                     (TC_REACTOR_EXT_1, FAULT_OPEN)])):
+        summary, rows = replay(steady_case(seconds, faults), args.program, trace=True)
+        after = trip_after_s(rows)
+        failures = [] if after is not None else ["did not trip"]
+        results.append({"case": name, "expect": "trip", "trip_after_s": after, "failures": failures})
+
+    def worst_dev(rows):
+        # reac1's worst distance from setpoint after the fault, by the
+        # plant's own temperature
+        return round(max(abs(r["sp_reac1"] - r["pv_reac1"]) for r in rows if r["t_s"] >= FAULT_AT_S), 2)
+
+    for sp in args.failover_sps:
+        setpoints = dict(SETPOINTS, reac1=sp)
+        _, normal = replay(steady_case(seconds, setpoints=setpoints), args.program, trace=True)
+        summary, rows = replay(steady_case(seconds, [(TC_REACTOR_INT_1, FAULT_OPEN)], setpoints),
+                               args.program, trace=True)
+        worst, normal_worst = worst_dev(rows), worst_dev(normal)
+        lead = round(max(r["heater_reac1"] - r["wall_reac1"] for r in rows if r["t_s"] >= FAULT_AT_S), 2)
+        failures = []
+        if summary["trips"]:
+            failures.append(f"tripped {summary['trips']} times")
+        if not summary["tc_faulted_ticks"].get("t_r_i1"):
+            failures.append("t_r_i1 never reported faulted")
+        if worst > normal_worst * args.max_failover_ratio:
+            failures.append(f"reac1 off setpoint by {worst} C, {normal_worst} C without the fault")
+        if lead > args.limit_margin:
+            failures.append(f"reac1 heater {lead} C above the wall, margin {args.limit_margin} C")
+        results.append({"case": f"reac1 int TC open, {sp:g} C", "expect": "failover",
+                        "trip_after_s": trip_after_s(rows),
+                        "reac1_worst_dev_c": worst, "reac1_normal_worst_dev_c": normal_worst,
+                        "reac1_heater_lead_c": lead,
+                        "failures": failures})
+    return results
+
+
+def print_report(glitches, persistent, args):
+    print(f"Glitch bursts of up to {args.burst} reads on every TC, {args.hours} h at steady state per rate")
+    print("chance/read  trips  trips/h  faulted TC ticks")
+    for r in glitches:
+        print(f"{r['rate']:11}  {r['trips']:5}  {r['trips_per_h']:7}  {r['faulted_ticks']:16}")
+    print(f"Persistent faults at t={FAULT_AT_S:.0f} s")
+    for r in persistent:
+        detail = f"trip after {r['trip_after_s']} s" if r["trip_after_s"] is not None else "no trip"
+        if "reac1_worst_dev_c" in r:
+            detail += (f", reac1 worst dev {r['reac1_worst_dev_c']} C ({r['reac1_normal_worst_dev_c']} unfaulted)"
+                       f", heater {r['reac1_heater_lead_c']} C above the wall")
+        print(f"  {r['case']:29} expect {r['expect']:8} {detail:52} {'ok' if not r['failures'] else 'FAILED'}")
+        for f in r["failures"]:
+            print(f"    {f}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--program", default=DEFAULT_REPLAY_BIN, help="replay program")
+    ap.add_argument("--rates", type=lambda s: [float(x) for x in s.split(",")], default=[0.0001, 0.001, 0.01])
+    ap.add_argument("--burst", type=int, default=2, help="longest glitch burst, in reads")
+    ap.add_argument("--hours", type=float, default=2.0, help="simulated time per glitch rate")
+    ap.add_argument("--fault-seconds", type=float, default=1800.0, help="simulated time after a persistent fault")
+    ap.add_argument("--failover-sps", type=lambda s: [float(x) for x in s.split(",")], default=[450.0, 600.0],
+                    help="reac1 setpoints to fail over at")
+    ap.add_argument("--max-failover-ratio", type=float, default=1.25,
+                    help="reac1 deviation after failover, relative to the unfaulted run")
+    ap.add_argument("--limit-margin", type=float, default=125.0,
+                    help="TC_BACKUP_LIMIT_MARGIN_C in firmware config.h")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-trips-per-h", type=float, help="fail if a glitch run trips more often")
+    args = ap.parse_args()
+
+    glitches = [glitch_run(rate, args) for rate in args.rates]
+    persistent = persistent_runs(args)
+    if args.json:
+        print(json.dumps({"glitches": glitches, "persistent": persistent}, indent=2))
+    else:
+        print_report(glitches, persistent, args)
+
+    failed = [f"{r['case']}: {f}" for r in persistent for f in r["failures"]]
+    if args.max_trips_per_h is not None:
+        failed += [f"glitch rate {r['rate']}: {r['trips_per_h']} trips/h > {args.max_trips_per_h}"
+                   for r in glitches if r["trips_per_h"] > args.max_trips_per_h]
+    for f in failed:
+        print(f"REGRESSION: {f}", file=sys.stderr)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
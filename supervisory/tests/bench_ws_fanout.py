@@ -0,0 +1,163 @@
+"""/ws fan-out cost: per-client queues and encoding vs the broadcast hub.
+
+Publishes synthetic telemetry frames at --rate Hz to --clients WebSocket
+consumers in-process, one of which never reads (a stalled browser tab). Each
+consumer does what the /ws handler does short of the socket write. The run is
+repeated for the old fan-out (an unbounded asyncio.Queue per client, awaited
+in turn, and send_json encoding per client) and for app.ws_hub. It reports:
+  - event-loop CPU per frame: publishing plus every consumer's share
+  - publish time per frame (p99): how long telemetry handling is held up
+  - frames queued for the stalled client at the end (memory it pins)
+  - fast clients' publish -> send lag (p99) and encoded bytes per frame
+
+    python tests/bench_ws_fanout.py --clients 1,10,50 --rate 100 --max-cpu-ms 1
+"""
+import argparse
+import asyncio
+import json
+import os
+import sys
+import time
+
+SUPERVISORY_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, SUPERVISORY_DIR)
+
+from bench_command_chain import percentile
+from bench_log_writer import frame
+
+
+class LegacyFanout:
+    # Orchestrator.subscribers before the hub
+    def __init__(self):
+        self.subscribers = []
+
+    async def publish(self, data):
+        for q in list(self.subscribers):
+            await q.put((time.perf_counter(), data))
+
+    def subscribe(self):
+        q = asyncio.Queue()
+        self.subscribers.append(q)
+        return q
+
+    @staticmethod
+    async def consume(q, lags, sizes):
+        while True:
+            t, data = await q.get()
+            payload = json.dumps(data, separators=(",", ":"), ensure_ascii=False)  # send_json
+            sizes.append(len(payload))
+            lags.append((time.perf_counter() - t) * 1000.0)
+            await asyncio.sleep(0)  # The socket write yields
+
+
+async def run_legacy(n_clients, args):
+    fanout = LegacyFanout()
+    stalled = fanout.subscribe()
+    lags, sizes = [], []
+    tasks = [asyncio.create_task(fanout.consume(fanout.subscribe(), lags, sizes)) for _ in range(n_clients - 1)]
+    publish_ms = await feed(fanout.publish, args)
+    queued = stalled.qsize()
+    for t in tasks:
+        t.cancel()
+    return publish_ms, queued, lags, sizes
+
+
+async def run_hub(n_clients, args):
+    from app.ws_hub import WebSocketHub
+
+    hub = WebSocketHub()
+    stalled = hub.subscribe("stalled", args.policy, args.delta)
+    lags, sizes = [], []
+
+    async def consume(client):
+        while True:
+            payload = await client.next()
+            sizes.append(len(payload))
+            lags.append(client.stats["lag_ms"])
+            await asyncio.sleep(0)
+
+    clients = [hub.subscribe(f"fast{i}", args.policy, args.delta) for i in range(n_clients - 1)]
+    tasks = [asyncio.create_task(consume(c)) for c in clients]
+
+    async def publish(data):
+        hub.publish(data)
+
+    publish_ms = await feed(publish, args)
+    queued = stalled.get_stats()["queued"]
+    for t in tasks:
+        t.cancel()
+    return publish_ms, queued, lags, sizes
+
+
+async def feed(publish, args):
+    # Returns per-frame publish times and the loop's CPU time per frame
+    times, n = [], int(args.rate * args.seconds)
+    cpu0 = time.process_time()
+    start = time.perf_counter()
+    for i in range(n):
+        delay = start + i / args.rate - time.perf_counter()
+        await asyncio.sleep(max(0.0, delay))
+        data = frame(i)
+        t0 = time.perf_counter()
+        await publish(data)
+        times.append((time.perf_counter() - t0) * 1000.0)
+    await asyncio.sleep(0.1)  # Let consumers drain
+    return times, (time.process_time() - cpu0) * 1000.0 / n
+
+
+def bench(args):
+    results = []
+    for n in args.clients:
+        for label, run in (("per-client queue", run_legacy), ("hub", run_hub)):
+            (publish_ms, cpu_ms), queued, lags, sizes = asyncio.run(run(n, args))
+            results.append({
+                "fanout": label, "clients": n,
+                "cpu_ms_per_frame": round(cpu_ms, 3),
+                "publish_p99_ms": round(percentile(publish_ms, 99), 3),
+                "stalled_queued": queued,
+                "lag_p99_ms": round(percentile(lags, 99), 2) if lags else None,
+                "bytes_per_frame": round(sum(sizes) / len(sizes)) if sizes else None,
+            })
+    return results
+
+
+def print_report(results, args):
+    print(f"{args.rate} Hz for {args.seconds} s, hub policy {args.policy}{', delta' if args.delta else ''}")
+    print("fanout            clients  CPU/frame (ms)  publish p99 (ms)  stalled queued  lag p99 (ms)  bytes/frame")
+    for r in results:
+        print(f"{r['fanout']:17} {r['clients']:7}  {r['cpu_ms_per_frame']:14}  {r['publish_p99_ms']:16}  "
+              f"{r['stalled_queued']:14}  "
+              f"{str(r['lag_p99_ms']):>12}  {str(r['bytes_per_frame']):>11}")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--clients", type=lambda s: [int(x) for x in s.split(",")], default=[1, 10, 50])
+    ap.add_argument("--rate", type=float, default=100.0)
+    ap.add_argument("--seconds", type=float, default=5.0)
+    ap.add_argument("--policy", choices=("drop_oldest", "latest"), default="drop_oldest")
+    ap.add_argument("--delta", action="store_true", help="hub clients take the delta stream")
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-p99-ms", type=float, help="fail if hub publish p99 exceeds this")
+    ap.add_argument("--max-cpu-ms", type=float, help="fail if hub loop CPU per frame exceeds this")
+    args = ap.parse_args()
+
+    results = bench(args)
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print_report(results, args)
+
+    hub = [r for r in results if r["fanout"] == "hub"]
+    failed = []
+    if args.max_p99_ms is not None and max(r["publish_p99_ms"] for r in hub) > args.max_p99_ms:
+        failed.append(f"hub publish p99 > {args.max_p99_ms} ms")
+    if args.max_cpu_ms is not None and max(r["cpu_ms_per_frame"] for r in hub) > args.max_cpu_ms:
+        failed.append(f"hub CPU per frame > {args.max_cpu_ms} ms")
+    for f in failed:
+        print(f"REGRESSION: {f}", file=sys.stderr)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,236 @@
+"""Reactor zone 1/2 coupling: identify the cross-coupling and compare setpoint steps with and without decoupling.
+
+Both reactor zones heat the same tube. With decoupling off, this steps
+reactor 1, then reactor 2, then both back together. After each step it waits
+for the PIDs to settle. The closed-loop steady state gives the coupling
+directly. When reactor 1's setpoint rises, reactor 2's PID has to back off by
+du2 for every du1 that reactor 1 adds. That ratio is reactor 2's decoupling
+gain (DECOUPLE_K_REAC2), and the reactor 2 step gives DECOUPLE_K_REAC1 the
+same way. The heat takes time to get along the tube. So the lag is the time the
+backing-off zone's output needs to cover 63% of its change. The same three
+steps are then repeated with those gains and that lag, or the ones given with
+--k-reac1/--k-reac2/--lag.
+
+Each step reports:
+  - the joint settling time: until both zones are within --tolerance
+  - each zone's largest setpoint error. For the zone that was not stepped,
+    this is how hard the other zone disturbed it.
+  - the largest and the time-integrated zone-to-zone spread: how far the two
+    zones' setpoint errors differ. This is the uniformity figure for the joint
+    step.
+
+The decoupler assumes loops that settle on their own. The default firmware
+tunings limit-cycle on the simulated reactor, so --pid sets the reactor zones'
+tunings first.
+
+Simulation (native firmware build, which couples the two reactor zones):
+    python tests/bench_zone_coupling.py --controller host --pid 5,0.05,0
+On the rig, against the running supervisor (reactor heaters live!):
+    python tests/bench_zone_coupling.py --url http://<pi>:8000 --sp 400 --step-c 20 \\
+        --steady-s 300 --settle-timeout 7200
+"""
+import argparse
+import asyncio
+import json
+import os
+import sys
+import tempfile
+import time
+
+from bench_command_chain import free_port, start_controller, start_supervisor, stop, DEFAULT_HOST_BIN
+from bench_flow_disturbance import Recorder, mean_output, post, smoothed_errors, wait_steady
+from app.config import COUPLED_ZONES, ZONE_KEYS, ZONE_PV_TCS
+
+# (zone index, key under heaters/sp, PV telemetry keys, unused) as in bench_flow_disturbance
+REACTOR_ZONES = tuple((i, key, ZONE_PV_TCS[key], None) for i, key in enumerate(ZONE_KEYS) if key in COUPLED_ZONES)
+
+
+def zone_errors(samples):
+    # {t: {key: smoothed error}} for samples where both zones have a PV
+    by_t = {}
+    for _, key, pv_key, _ in REACTOR_ZONES:
+        for t, e in smoothed_errors(samples, key, pv_key):
+            by_t.setdefault(t, {})[key] = e
+    return sorted((t, e) for t, e in by_t.items() if len(e) == len(REACTOR_ZONES))
+
+
+def step_metrics(samples, t_step, tolerance):
+    spread_max, spread_iae, last_out, prev_t = 0.0, 0.0, t_step, t_step
+    max_error = {key: 0.0 for _, key, _, _ in REACTOR_ZONES}
+    for t, e in zone_errors(samples):
+        spread = abs(e["reac1"] - e["reac2"])
+        spread_max = max(spread_max, spread)
+        spread_iae += spread * (t - prev_t)
+        prev_t = t
+        for key, v in e.items():
+            max_error[key] = max(max_error[key], abs(v))
+        if any(abs(v) > tolerance for v in e.values()):
+            last_out = t
+    return {"settle_s": round(last_out - t_step, 1),
+            "max_error_c": {key: round(v, 2) for key, v in max_error.items()},
+            "spread_max_c": round(spread_max, 2), "spread_iae_c_s": round(spread_iae, 1)}
+
+
+async def run_step(base, rec, args, label, setpoints):
+    """Moves the reactor setpoints to setpoints ({key: value}) and waits for both to settle."""
+    before = await wait_steady(rec, args, label, REACTOR_ZONES)
+    t_step = time.time()
+    for zone, key, _, _ in REACTOR_ZONES:
+        if key in setpoints:
+            post(base, "/api/control/setpoint", zone=zone, value=setpoints[key])
+    await asyncio.sleep(args.steady_s)
+    after = await wait_steady(rec, args, label, REACTOR_ZONES)
+
+    samples = rec.since(t_step)
+    result = step_metrics(samples, t_step, args.tolerance)
+    result["label"] = label
+    result["d_output"], result["output_lag_s"] = {}, {}
+    for _, key, _, _ in REACTOR_ZONES:
+        u0, u1 = mean_output(before, key), mean_output(after, key)
+        result["d_output"][key] = u1 - u0
+        result["output_lag_s"][key] = output_lag(samples, t_step, key, u0, u1)
+    return result
+
+
+def output_lag(samples, t_step, key, u0, u1):
+    # First-order time constant of a heater output change
+    target = u0 + 0.63 * (u1 - u0)
+    for t, m in samples:
+        if (m["heaters"][key] - target) * (u1 - u0) >= 0:
+            return round(t - t_step, 1)
+    return None
+
+
+async def run_sequence(base, rec, args, label):
+    sp, hi = args.sp, args.sp + args.step_c
+    return [
+        await run_step(base, rec, args, f"{label}: reac1 step", {"reac1": hi}),
+        await run_step(base, rec, args, f"{label}: reac2 step", {"reac2": hi}),
+        await run_step(base, rec, args, f"{label}: joint step", {"reac1": sp, "reac2": sp}),
+    ]
+
+
+def fit_gains(steps):
+    # Each zone's gain is its own output change over the stepped zone's
+    # output change, in the step where only the other zone moved
+    reac1_step, reac2_step = steps[0]["d_output"], steps[1]["d_output"]
+    gains = {}
+    if abs(reac1_step["reac1"]) > 1e-6:
+        gains["reac2"] = reac1_step["reac2"] / reac1_step["reac1"]
+    if abs(reac2_step["reac2"]) > 1e-6:
+        gains["reac1"] = reac2_step["reac1"] / reac2_step["reac2"]
+    return gains
+
+
+def fit_lag(steps):
+    # The zone that wasn't stepped only backs off once the heat has arrived
+    lags = [steps[0]["output_lag_s"]["reac2"], steps[1]["output_lag_s"]["reac1"]]
+    lags = [lag for lag in lags if lag is not None]
+    return round(sum(lags) / len(lags), 1) if lags else 0.0
+
+
+def set_decoupling(base, gains, lag):
+    for zone, key, _, _ in REACTOR_ZONES:
+        post(base, "/api/control/decoupling", zone=zone, k=gains.get(key, 0.0), lag=lag)
+
+
+async def bench(args, base):
+    rec = Recorder()
+    rec_task = asyncio.create_task(rec.run(base.replace("http://", "ws://") + "/ws"))
+
+    set_decoupling(base, {}, 0.0)
+    if args.pid:
+        for zone, _, _, _ in REACTOR_ZONES:
+            post(base, "/api/control/pid", zone=zone, kp=args.pid[0], ki=args.pid[1], kd=args.pid[2])
+    for zone, _, _, _ in REACTOR_ZONES:
+        post(base, "/api/control/setpoint", zone=zone, value=args.sp)
+    post(base, "/api/control/state/1")  # WARMUP: heaters enabled
+
+    try:
+        before = await run_sequence(base, rec, args, "decoupling off")
+        fitted = fit_gains(before)
+        gains = {"reac1": args.k_reac1, "reac2": args.k_reac2}
+        for key in gains:
+            if gains[key] is None:
+                gains[key] = fitted.get(key, 0.0)
+
+        lag = args.lag if args.lag is not None else fit_lag(before)
+
+        set_decoupling(base, gains, lag)
+        after = await run_sequence(base, rec, args, "decoupling on")
+    finally:
+        if not args.keep_gains:
+            set_decoupling(base, {}, 0.0)
+        if not args.keep_running:
+            post(base, "/api/control/state/0")
+        rec_task.cancel()
+
+    return {"before": before, "after": after, "gains": gains, "fitted_gains": fitted,
+            "lag_s": lag, "sp_c": [args.sp, args.sp + args.step_c]}
+
+
+def print_report(r):
+    print(f"Reactor setpoint steps {r['sp_c'][0]} <-> {r['sp_c'][1]} C")
+    print("step                        settle (s)  max err reac1/reac2 (C)  max spread (C)  spread IAE (C*s)")
+    for step in r["before"] + r["after"]:
+        err = "{reac1:>10} /{reac2:>6}".format(**step["max_error_c"])
+        print(f"{step['label']:27} {step['settle_s']:10}  {err:23}  {step['spread_max_c']:14}  "
+              f"{step['spread_iae_c_s']:16}")
+    print("Decoupling used (DECOUPLE_K_*): " + ", ".join(f"{k}={v:.4g}" for k, v in r["gains"].items())
+          + f", lag {r['lag_s']} s")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--url", help="existing supervisor (rig); otherwise start one")
+    ap.add_argument("--controller", choices=("host", "mock"), default="host")
+    ap.add_argument("--host-bin", default=DEFAULT_HOST_BIN, help="native firmware binary")
+    ap.add_argument("--pty", action="store_true", help="connect to the native build over a pty")
+    ap.add_argument("--sp", type=float, default=400.0)
+    ap.add_argument("--step-c", type=float, default=20.0)
+    ap.add_argument("--tolerance", type=float, default=2.0, help="settled band, degrees C")
+    ap.add_argument("--steady-s", type=float, default=10.0)
+    ap.add_argument("--settle-timeout", type=float, default=900.0)
+    ap.add_argument("--pid", type=lambda s: [float(x) for x in s.split(",")],
+                    help="kp,ki,kd for both reactor zones (default: leave as is)")
+    ap.add_argument("--k-reac1", type=float, help="gain instead of the fitted one")
+    ap.add_argument("--k-reac2", type=float, help="gain instead of the fitted one")
+    ap.add_argument("--lag", type=float, help="cross-term lag in s instead of the fitted one, 0 = static")
+    ap.add_argument("--keep-gains", action="store_true", help="leave the gains set afterwards")
+    ap.add_argument("--keep-running", action="store_true", help="don't return to STANDBY afterwards")
+    ap.add_argument("--json", action="store_true")
+    ap.add_argument("--max-settle-s", type=float, help="fail if a decoupled step takes longer to settle")
+    args = ap.parse_args()
+
+    controller = supervisor = None
+    try:
+        if args.url:
+            base = args.url.rstrip("/")
+            result = asyncio.run(bench(args, base))
+        else:
+            controller, serial_port = start_controller(args)
+            with tempfile.TemporaryDirectory() as tmp:
+                supervisor, base = start_supervisor(serial_port, free_port(), os.path.join(tmp, "bench.db"))
+                result = asyncio.run(bench(args, base))
+                stop(supervisor)
+                supervisor = None
+    finally:
+        if supervisor:
+            stop(supervisor)
+        if controller:
+            stop(controller)
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print_report(result)
+
+    if args.max_settle_s is not None:
+        worst = max(step["settle_s"] for step in result["after"])
+        if worst > args.max_settle_s:
+            print(f"REGRESSION: settling {worst} s > {args.max_settle_s} s", file=sys.stderr)
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,4 +1,5 @@
 import asyncio
+import binascii
 import json
 import random
 import time
@@ -7,6 +8,18 @@ import time
 HOST = '127.0.0.1'
 PORT = 9999
 
+def frame(msg: dict) -> bytes:
+    # Same "<json>*XXXX" CRC-16 framing as the firmware
+    payload = json.dumps(msg)
+    crc = binascii.crc_hqx(payload.encode(), 0xFFFF)
+    return f"{payload}*{crc:04X}\n".encode()
+
+def unframe(line: str) -> str:
+    star = line.rfind("*")
+    if star >= 0 and len(line) - star == 5:
+        return line[:star]
+    return line
+
 class MockReactor:
     def __init__(self):
         self.temp_gas = 25.0
@@ -32,6 +45,8 @@ class MockReactor:
         self.mfc_flow = 0.0
         
         self.start_time = time.time()
+        self.last_seq = 0
+        self.fseq = 0
 
     def update(self):
         dt = 0.1 # 100ms
@@ -75,9 +90,15 @@ class MockReactor:
         # Noise
         self.temp_gas += random.uniform(-0.1, 0.1)
 
+    def millis(self):
+        return int((time.time() - self.start_time) * 1000) & 0xFFFFFFFF
+
     def get_telemetry(self):
+        self.fseq += 1
         return {
             "uptime": int(self.uptime),
+            "t_ms": self.millis(),
+            "fseq": self.fseq,
             "state": self.state,
             "sensors": {
                 "t_gas": round(self.temp_gas, 1),
@@ -108,8 +129,28 @@ class MockReactor:
         }
 
     def handle_command(self, cmd):
+        # Returns the ack to send back (None for unsequenced commands)
         print(f"Received: {cmd}")
-        if cmd.get("cmd") == "SET_STATE":
+        seq = cmd.get("seq", 0)
+        if cmd.get("cmd") == "PING":
+            return {"ack": seq, "t_ms": self.millis()}
+        if cmd.get("cmd") == "GET_STATS":
+            # Made-up placeholders, not measured on a Mega; "mock" marks them
+            # so nobody reads them as the firmware's footprint
+            return {"ack": seq, "mem": {"static": 1900, "heap": 420, "free": 5600,
+                                        "stack_peak": 610, "stack_headroom": 5150,
+                                        "heap_free_list": 0, "heap_largest_free": 0,
+                                        "heap_frag_pct": 0, "mock": True}}
+        if seq and seq == self.last_seq:
+            return {"ack": seq}  # Retry: ack again, don't re-execute
+        self.last_seq = seq
+        ack = {"ack": seq} if seq else None
+
+        if cmd.get("cmd") == "SET_BAUD":
+            # Nothing to switch on a socket, just confirm
+            if ack:
+                ack["baud"] = cmd.get("baud")
+        elif cmd.get("cmd") == "SET_STATE":
             try:
                 self.state = int(cmd.get("state"))
                 print(f"MOCK: State set to {self.state}")
@@ -126,6 +167,16 @@ class MockReactor:
             if z == 1: self.sp_vap = v
             if z == 2: self.sp_reac_1 = v
             if z == 3: self.sp_reac_2 = v
+        elif cmd.get("cmd") == "SET_FF":
+            # The mock has no flow load to compensate, just log it
+            print(f"MOCK: Feedforward zone {cmd.get('zone')} base={cmd.get('base')} per_k={cmd.get('per_k')}")
+        elif cmd.get("cmd") == "SET_DECOUPLE":
+            # Reactor zones are independent in the mock
+            print(f"MOCK: Decoupling zone {cmd.get('zone')} k={cmd.get('k')} lag={cmd.get('lag')}")
+        elif cmd.get("cmd") == "SET_PID":
+            # The mock runs a fixed P controller
+            print(f"MOCK: Tunings zone {cmd.get('zone')} kp={cmd.get('kp')} ki={cmd.get('ki')} kd={cmd.get('kd')}")
+        return ack
 
 async def handle_client(reader, writer):
     print("Client Connected")
@@ -141,7 +192,7 @@ async def handle_client(reader, writer):
             reactor.update()
             if int(reactor.uptime * 10) % 10 == 0: # Approx 1Hz send
                 telemetry = reactor.get_telemetry()
-                writer.write((json.dumps(telemetry) + "\n").encode())
+                writer.write(frame(telemetry))
                 await writer.drain()
             
             # Read Check
@@ -150,8 +201,11 @@ async def handle_client(reader, writer):
                 data = await asyncio.wait_for(reader.readline(), timeout=0.1)
                 if data:
                     try:
-                        cmd = json.loads(data.decode())
-                        reactor.handle_command(cmd)
+                        cmd = json.loads(unframe(data.decode().strip()))
+                        ack = reactor.handle_command(cmd)
+                        if ack:
+                            writer.write(frame(ack))
+                            await writer.drain()
                     except Exception as e:
                         print(f"JSON Error: {e}")
                 else:
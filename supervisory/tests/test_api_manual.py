@@ -31,7 +31,7 @@ def start_warmup():
 
 def get_history():
     try:
-        url = f"{BASE_URL}/api/history"
+        url = f"{BASE_URL}/api/live"
         with urllib.request.urlopen(url) as f:
             data = json.loads(f.read().decode('utf-8'))
             if len(data) > 0: